@@ -39,19 +39,31 @@ IFS="
 l=()
 builddir=build
 cc=cc
+ar=ar
 srcdir=src
+tooldir=tools
 cflags=(-ansi -Wall -Wextra -Wpedantic -I$srcdir)
-ldflags=(-lX11)
+ldflags=()
+libs=(-lX11 -lXext -lpthread)
+
+# Sources that are only part of the emulator itself, everything else in $srcdir
+# ends up in a static library the tools get linked against.
+frontend=(main.c gui.c)
 
 debug=false
 prof=false
+counters=false
+telemetry=false
 
-help="USAGE: $0 [-d] [-p]\n\nOptions:\n-d  Debug build\n-p  Profiling build"
+help="USAGE: $0 [-d] [-p] [-c] [-t]\n\nOptions:\n-d  Debug build\n-p  Profiling build"
+help+="\n-c  Count emulated events\n-t  Record frame time telemetry"
 
-while getopts "dph" flag; do
+while getopts "dpcth" flag; do
     case "${flag}" in
         d) debug=true ;;
         p) prof=true ;;
+        c) counters=true ;;
+        t) telemetry=true ;;
         h) echo -e ${help[@]}
            exit 0 ;;
     esac
@@ -72,29 +84,85 @@ if [ $prof = true ]; then
     cflags+=(-DMN_CONFIG_PROF=1)
 fi
 
+if [ $counters = true ]; then
+    echo "-- Event counters enabled!"
+    cflags+=(-DMN_CONFIG_COUNTERS=1)
+fi
+
+if [ $telemetry = true ]; then
+    echo "-- Frame time telemetry enabled!"
+    cflags+=(-DMN_CONFIG_TELEMETRY=1)
+fi
+
 out=$builddir/main
+lib=$builddir/libmibines.a
 
 mkdir -p $builddir
 
-for i in $(find $srcdir -mindepth 1 -type f -name "*.c"); do
-    obj=$builddir/${i#$srcdir*}.o
-    echo "-- Compiling $i to $obj..."
-    mkdir -p $(dirname $obj)
-    $cc -c $i -o $obj ${cflags[@]}
+fail() {
+    echo "-- Build failed with error code $1!"
+    exit $1
+}
+
+# compile [SOURCE] [OBJECT]
+compile() {
+    echo "-- Compiling $1 to $2..."
+    mkdir -p $(dirname $2)
+    $cc -c $1 -o $2 ${cflags[@]}
     rc=$?
     if [ $rc -ne 0 ]; then
-        echo "-- Build failed with error code $rc!"
-        exit $rc
+        fail $rc
+    fi
+}
+
+core=()
+
+for i in $(find $srcdir -mindepth 1 -type f -name "*.c"); do
+    obj=$builddir/${i#$srcdir*}.o
+    compile $i $obj
+    is_frontend=false
+    for f in ${frontend[@]}; do
+        if [ "${i#$srcdir/}" = "$f" ]; then
+            is_frontend=true
+        fi
+    done
+    if [ $is_frontend = true ]; then
+        l+=($obj)
+    else
+        core+=($obj)
     fi
-    l+=($obj)
 done
 
+echo "-- Archiving ${core[@]} to $lib..."
+
+rm -f $lib
+$ar rcs $lib ${core[@]}
+
+rc=$?
+if [ $rc -ne 0 ]; then
+    fail $rc
+fi
+
 echo "-- Linking ${l[@]}..."
 
-cc -o $out ${ldflags[@]} ${l[@]}
+$cc -o $out ${l[@]} $lib ${ldflags[@]} ${libs[@]}
 
 rc=$?
 if [ $rc -ne 0 ]; then
-    echo "-- Build failed with error code $rc!"
-    exit $rc
+    fail $rc
 fi
+
+for i in $(find $tooldir -mindepth 1 -maxdepth 1 -type f -name "*.c"); do
+    obj=$builddir/$i.o
+    tool=$builddir/$(basename $i .c)
+    compile $i $obj
+
+    echo "-- Linking $tool..."
+
+    $cc -o $tool $obj $lib ${ldflags[@]}
+
+    rc=$?
+    if [ $rc -ne 0 ]; then
+        fail $rc
+    fi
+done
@@ -38,6 +38,10 @@
 /* Build config */
 
 #define MN_CONFIG_PPU_DEBUG_SPRITE_EVAL 0
+/* Evaluate the sprites of lines with less than 8 sprites at once */
+#define MN_CONFIG_PPU_FAST_SPRITE_EVAL  1
+/* Only run the CPU during the idle dots of VBlank */
+#define MN_CONFIG_PPU_FAST_VBLANK       1
 
 #define MN_CONFIG_CPU_DEBUG             0
 #define MN_CONFIG_CPU_CYCLE_DETAIL      0
@@ -48,11 +52,20 @@
 
 #define MN_CONFIG_MAPPER_DEBUG_RW       0
 
+/* Use SIMD kernels when the CPU supports them */
+#define MN_CONFIG_SIMD                  1
+
+/* Tracing still has to be enabled at runtime, this only allows it */
+#define MN_CONFIG_TRACE                 1
+#define MN_CONFIG_TRACE_SIZE            (1<<20)
+
 /* Stuff that gets defined (or not) when compiling */
 
 #if 0
 
 #define MN_CONFIG_PROF                  0
+#define MN_CONFIG_COUNTERS              0
+#define MN_CONFIG_TELEMETRY             0
 
 #endif
 
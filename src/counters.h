@@ -0,0 +1,63 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MN_COUNTERS_H
+#define MN_COUNTERS_H
+
+#include <emu.h>
+
+#include <config.h>
+
+#if MN_CONFIG_COUNTERS
+
+#define MN_COUNTERS_REGION(addr) ((addr) < 0x2000 ? MN_COUNTERS_RAM : \
+                                  (addr) < 0x4000 ? MN_COUNTERS_PPU : \
+                                  (addr) < 0x4020 ? MN_COUNTERS_IO : \
+                                  (addr) < 0x8000 ? MN_COUNTERS_CART : \
+                                  MN_COUNTERS_PRG)
+
+#define MN_COUNT(emu, counter) ((emu)->counters.counter++)
+#define MN_COUNT_ADD(emu, counter, value) ((emu)->counters.counter += (value))
+#define MN_COUNT_ACCESS(emu, counter, addr) \
+    ((emu)->counters.counter[MN_COUNTERS_REGION(addr)]++)
+
+#else
+
+#define MN_COUNT(emu, counter)
+#define MN_COUNT_ADD(emu, counter, value)
+#define MN_COUNT_ACCESS(emu, counter, addr)
+
+#endif
+
+#endif /* MN_COUNTERS_H */
@@ -34,6 +34,9 @@
 
 #include <cpu.h>
 
+#include <trace.h>
+#include <counters.h>
+
 #if MN_CONFIG_CPU_DEBUG
 /* NOTE: For debugging only */
 #include <stdio.h>
@@ -54,6 +57,9 @@ int mn_cpu_init(MNCPU *cpu) {
     cpu->cycle = 8;
     cpu->target_cycle = 0;
 
+    /* Start counting after the reset sequence, like in nestest.log */
+    cpu->cycles = 7;
+
     cpu->rdy = 1;
 
     cpu->irq_pin = 0;
@@ -3094,6 +3100,9 @@ void mn_cpu_cycle(MNCPU *cpu, MNEmu *emu) {
      * https://www.nesdev.org/wiki/Instruction_reference#ADC
      */
 
+    cpu->cycles++;
+    MN_COUNT(emu, cpu_cycles);
+
     if(cpu->jammed) return;
     if(cpu->halted){
         MN_CPU_READ(cpu->last_read);
@@ -3109,6 +3118,9 @@ void mn_cpu_cycle(MNCPU *cpu, MNEmu *emu) {
 
     if(cpu->cycle == 2){
         cpu->t = MN_CPU_READ(cpu->pc);
+        if(!cpu->execute_int){
+            MN_TRACE_OPERAND(emu, 0, cpu->t);
+        }
     }else if(cpu->cycle > cpu->target_cycle){
         cpu->opcode = MN_CPU_READ(cpu->pc);
 OPCODE_LOADED:
@@ -3124,6 +3136,8 @@ OPCODE_LOADED:
             puts("INT");
 #endif
         }else{
+            MN_TRACE_OP(emu);
+            MN_COUNT(emu, instructions);
             cpu->pc++;
         }
     }
@@ -3179,6 +3193,12 @@ OPCODE_LOADED:
         goto OPCODE_LOADED;
     }
 
+    /* The last byte of 3 byte instructions is read on cycle 3, except for JSR
+     * where it is only read on the last cycle. */
+    if(cpu->cycle == (cpu->opcode == 0x20 ? 6 : 3)){
+        MN_TRACE_OPERAND(emu, 1, cpu->last_read);
+    }
+
 #if MN_CONFIG_CPU_DEBUG && MN_CONFIG_CPU_CYCLE_DETAIL
     printf("c: %d ", cpu->cycle);
     MN_CPU_OP_INFO();
@@ -34,6 +34,8 @@
 
 #include <dma.h>
 
+#include <counters.h>
+
 /* TODO: Add support for DMC DMA */
 
 int mn_dma_init(MNDMA *dma) {
@@ -54,6 +56,9 @@ int mn_dma_init(MNDMA *dma) {
 void mn_dma_cycle(MNDMA *dma, MNEmu *emu) {
     if(dma->do_oam_dma){
         emu->cpu.rdy = 0;
+#if MN_CONFIG_COUNTERS
+        if(emu->cpu.halted) MN_COUNT(emu, dma_stalls);
+#endif
         if(emu->cpu.halted && ((!dma->cycle && !dma->aligned) ||
                                dma->aligned)){
             switch(dma->cycle){
@@ -41,13 +41,26 @@
 
 #include <ctrl.h>
 
+#include <trace.h>
+
+#include <stdlib.h>
+#include <string.h>
+
 #include <prof.h>
 
-int mn_emu_init(MNEmu *emu, void draw_pixel(long int color),
-                unsigned char player1_input(), unsigned char player2_input(),
-                MNCtrl ctrl1_type, MNCtrl ctrl2_type, unsigned char *rom,
-                unsigned char *palette, size_t size, int pal) {
+int mn_emu_init(MNEmu *emu, unsigned char player1_input(),
+                unsigned char player2_input(), MNCtrl ctrl1_type,
+                MNCtrl ctrl2_type, unsigned char *rom, unsigned char *palette,
+                size_t size, int pal) {
     emu->pal = pal;
+    emu->skip_video = 0;
+
+    mn_trace_init(&emu->trace);
+
+#if MN_CONFIG_COUNTERS
+    memset(&emu->counters, 0, sizeof(MNCounters));
+    memset(&emu->frame_counters, 0, sizeof(MNCounters));
+#endif
 
     if(mn_ctrl_init(&emu->ctrl1, emu, ctrl1_type, player1_input)){
         return MN_EMU_E_CTRL;
@@ -64,7 +77,10 @@ int mn_emu_init(MNEmu *emu, void draw_pixel(long int color),
     if(mn_dma_init(&emu->dma)){
         return MN_EMU_E_DMA;
     }
-    if(mn_ppu_init(&emu->ppu, palette, draw_pixel)){
+    if(mn_frame_init(&emu->frame, palette)){
+        return MN_EMU_E_PPU;
+    }
+    if(mn_ppu_init(&emu->ppu, &emu->frame)){
         return MN_EMU_E_PPU;
     }
     if(mn_apu_init(&emu->apu)){
@@ -99,10 +115,77 @@ void mn_emu_pixel(MNEmu *emu) {
 }
 
 void mn_emu_frame(MNEmu *emu) {
-    size_t i;
-    for(i=0;i<262*342;i++){
+    /* Stop right after the last visible scanline, so that every call outputs
+     * exactly one full picture. */
+    do{
+#if MN_CONFIG_PPU_FAST_VBLANK
+        if(mn_ppu_vblank(&emu->ppu, emu)) continue;
+#endif
         mn_emu_step(emu);
-    }
+    }while(emu->ppu.scanline != 240 || emu->ppu.cycle);
+
+#if MN_CONFIG_COUNTERS
+    emu->frame_counters = emu->counters;
+    memset(&emu->counters, 0, sizeof(MNCounters));
+#endif
+}
+
+int mn_emu_get_counters(MNEmu *emu, MNCounters *counters) {
+    /* Get the counters of the last frame that was emulated. Returns 1 if
+     * counters are not available in this build. */
+#if MN_CONFIG_COUNTERS
+    *counters = emu->frame_counters;
+
+    return 0;
+#else
+    (void)emu;
+    memset(counters, 0, sizeof(MNCounters));
+
+    return 1;
+#endif
+}
+
+int mn_emu_snapshot_init(MNEmu *emu, MNSnapshot *snapshot) {
+    /* Allocate the memory needed to save the state of emu. Returns 1 on
+     * failure. */
+    snapshot->mapper = malloc(emu->mapper.state_size(emu, &emu->mapper));
+
+    return snapshot->mapper == NULL;
+}
+
+void mn_emu_save_state(MNEmu *emu, MNSnapshot *snapshot) {
+    snapshot->cpu = emu->cpu;
+    snapshot->ppu = emu->ppu;
+    snapshot->apu = emu->apu;
+    snapshot->dma = emu->dma;
+    snapshot->ctrl1 = emu->ctrl1;
+    snapshot->ctrl2 = emu->ctrl2;
+#if MN_CONFIG_COUNTERS
+    snapshot->counters = emu->counters;
+    snapshot->frame_counters = emu->frame_counters;
+#endif
+
+    emu->mapper.save_state(emu, &emu->mapper, snapshot->mapper);
+}
+
+void mn_emu_load_state(MNEmu *emu, MNSnapshot *snapshot) {
+    emu->cpu = snapshot->cpu;
+    emu->ppu = snapshot->ppu;
+    emu->apu = snapshot->apu;
+    emu->dma = snapshot->dma;
+    emu->ctrl1 = snapshot->ctrl1;
+    emu->ctrl2 = snapshot->ctrl2;
+#if MN_CONFIG_COUNTERS
+    emu->counters = snapshot->counters;
+    emu->frame_counters = snapshot->frame_counters;
+#endif
+
+    emu->mapper.load_state(emu, &emu->mapper, snapshot->mapper);
+}
+
+void mn_emu_snapshot_free(MNSnapshot *snapshot) {
+    free(snapshot->mapper);
+    snapshot->mapper = NULL;
 }
 
 void mn_emu_step_into(MNEmu *emu) {
@@ -125,4 +208,5 @@ void mn_emu_free(MNEmu *emu) {
     mn_cpu_free(&emu->cpu);
     mn_ppu_free(&emu->ppu);
     mn_apu_free(&emu->apu);
+    mn_trace_free(&emu->trace);
 }
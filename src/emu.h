@@ -36,6 +36,9 @@
 #define MN_EMU_H
 
 #include <mapper.h>
+#include <frame.h>
+
+#include <config.h>
 
 typedef struct {
     /* Registers */
@@ -49,6 +52,9 @@ typedef struct {
     unsigned char cycle;
     unsigned char target_cycle;
 
+    /* Total amount of cycles since power on */
+    unsigned long int cycles;
+
     unsigned char opcode, t;
     unsigned short int tmp, tmp2;
 
@@ -78,6 +84,13 @@ typedef struct {
     unsigned int skip_and : 1;
 } MNCPU;
 
+/* A row of a tile decoded to 2 bits per pixel, with the leftmost pixel in the
+ * two upper bits, and the same row flipped horizontally. */
+typedef struct {
+    unsigned short int normal;
+    unsigned short int flipped;
+} MNTileRow;
+
 typedef struct {
     unsigned char primary_oam[256];
     unsigned char secondary_oam[32];
@@ -88,7 +101,7 @@ typedef struct {
 
     unsigned char io_bus;
     unsigned char video_mem_bus;
-    unsigned int addr : 16;
+    unsigned short int addr;
 
     unsigned char cycles_since_cpu_cycle;
 
@@ -99,25 +112,27 @@ typedef struct {
 
     unsigned short int startup_time;
 
-    /* Internal registers */
-    unsigned int v : 15; /* Current vram address */
-    unsigned int t : 15; /* Temorary vram address */
-    unsigned int x : 3;  /* Fine X scroll */
-    unsigned int w : 1;  /* First or second write toggle */
+    /* Internal registers. They are stored at the native width and masked
+     * where the hardware wraps around. */
+    unsigned short int v; /* Current vram address (15 bits) */
+    unsigned short int t; /* Temorary vram address (15 bits) */
+    unsigned char x;      /* Fine X scroll (3 bits) */
+    unsigned char w;      /* First or second write toggle */
 
     unsigned char tile_id;
     unsigned char attr;
-    /* The low and high bitplanes for that tile ID */
-    unsigned char low_bp, high_bp;
+    /* The decoded row of that tile ID */
+    unsigned short int row;
 
-    unsigned int low_shift : 16;
-    unsigned int high_shift : 16;
+    /* Two tiles of 2 bits per pixel, in the lower 32 bits. The bits shifted
+     * out of them are never read. */
+    unsigned long int shift;
 
-    unsigned int attr_latch1 : 1;
-    unsigned int attr_latch2 : 1;
+    unsigned char attr_latch1;
+    unsigned char attr_latch2;
 
-    unsigned int attr1_shift : 8;
-    unsigned int attr2_shift : 8;
+    unsigned char attr1_shift;
+    unsigned char attr2_shift;
 
     unsigned int n : 6;
     unsigned int m : 2;
@@ -130,8 +145,8 @@ typedef struct {
     /* See https://github.com/emu-russia/breaks/blob/master/BreakingNESWiki_Dee
      * pL/PPU/fifo.md */
     struct {
-        unsigned char low_bp;
-        unsigned char high_bp;
+        /* The decoded row, shifted left by 2 bits for each pixel. */
+        unsigned short int row;
         /* The down counter is initialized to the X position of the sprite and
          * counts down on each pixel. Once it reaches 0 the sprite starts
          * rendering. */
@@ -140,6 +155,18 @@ typedef struct {
         unsigned int priority : 1;
     } sprite_fifo[8];
 
+    /* The sprite pixels of the next line, painted during the sprite fetches.
+     * The FIFO isn't updated while it is used. */
+    unsigned char sprite_line[256];
+    unsigned char sprite_line_ok;
+
+    /* The pixels of the current line that were not output yet. They get
+     * combined all at once by mn_mux. */
+    unsigned char mux_bg[256];
+    unsigned char mux_sprites[256];
+    unsigned short int mux_start;
+    unsigned short int mux_end;
+
     unsigned char step;
 
     /* Pixel output is delayed 4 cycles further. */
@@ -149,25 +176,51 @@ typedef struct {
 
     unsigned char read_buffer;
 
-    unsigned int even_frame : 1;
+    unsigned char even_frame;
 
-    unsigned int trigger_nmi : 1;
+    unsigned char trigger_nmi;
 
-    unsigned int vblank : 1;
-    unsigned int sprite0_hit : 1;
-    unsigned int sprite_overflow : 1;
+    /* The VBlank, sprite 0 hit and sprite overflow flags, at their position in
+     * PPUSTATUS */
+    unsigned char status;
 
-    unsigned int keep_vblank_clear : 1;
+    unsigned char keep_vblank_clear;
+
+#if MN_CONFIG_PPU_FAST_VBLANK
+    /* Set on every register access, to leave the VBlank loop */
+    unsigned char accessed;
+#endif
 
     unsigned char ctrl;
     unsigned char mask;
 
-    unsigned int sprite0_loaded : 1;
-    unsigned int was_sprite0_loaded : 1;
-
-    unsigned char *palette;
-
-    void (*draw_pixel)(long int color);
+    unsigned char sprite0_loaded;
+    unsigned char was_sprite0_loaded;
+
+#if MN_CONFIG_PPU_FAST_SPRITE_EVAL
+    /* The first 8 sprites in range of each visible scanline */
+    unsigned char line_sprites[240][8];
+    unsigned char line_sprite_num[240];
+    unsigned char lines_valid;
+
+    /* Set while the evaluation of the current line is already done. What it
+     * modifies is kept as it was on dot 65 to be able to replay it. */
+    unsigned char fast_eval;
+    unsigned char eval_secondary_oam[32];
+    unsigned char eval_y;
+#endif
+
+    unsigned char palette_ram[32];
+
+    /* 1KB pages covering $0000-$3FFF, set up by the mapper. They're used by
+     * the rendering fetches, that never read the palette. */
+    unsigned char *pages[16];
+    /* The decoded rows of the 8 pattern table pages, set up by the mapper
+     * too. */
+    MNTileRow *rows[8];
+
+    /* The picture being output */
+    MNFrame *frame;
 } MNPPU;
 
 typedef struct {
@@ -209,6 +262,67 @@ typedef struct {
     void *data;
 } MNCtrl;
 
+typedef struct {
+    unsigned short int pc;
+    unsigned char opcode;
+    /* The bytes following the opcode, only the ones used by the instruction
+     * are meaningful. */
+    unsigned char operands[2];
+    unsigned char a;
+    unsigned char x;
+    unsigned char y;
+    unsigned char s;
+    unsigned char p;
+    unsigned short int scanline;
+    unsigned short int dot;
+    unsigned long int cycles;
+} MNTraceRecord;
+
+typedef struct {
+    /* Ring buffer of trace records. Its size is always a power of two. */
+    MNTraceRecord *records;
+    unsigned long int mask;
+    /* Amount of records written since tracing was started */
+    unsigned long int pos;
+
+    int enabled;
+} MNTrace;
+
+/* Regions of the CPU address space used to sort memory accesses */
+enum {
+    MN_COUNTERS_RAM,  /* $0000-$1FFF */
+    MN_COUNTERS_PPU,  /* $2000-$3FFF */
+    MN_COUNTERS_IO,   /* $4000-$401F */
+    MN_COUNTERS_CART, /* $4020-$7FFF */
+    MN_COUNTERS_PRG,  /* $8000-$FFFF */
+
+    MN_COUNTERS_REGION_AMOUNT
+};
+
+/* Emulated events counted during a frame. */
+typedef struct {
+    unsigned long int cpu_cycles;
+    unsigned long int instructions;
+
+    /* Mapper reads and writes, sorted by region */
+    unsigned long int reads[MN_COUNTERS_REGION_AMOUNT];
+    unsigned long int writes[MN_COUNTERS_REGION_AMOUNT];
+
+    /* Accesses to each of the 8 PPU registers */
+    unsigned long int ppu_reads[8];
+    unsigned long int ppu_writes[8];
+
+    /* CPU cycles lost because of OAM DMA */
+    unsigned long int dma_stalls;
+
+    unsigned long int nmis;
+
+    /* Scanlines on which sprite evaluation was performed, and the amount of
+     * sprites that were found in range on them. */
+    unsigned long int sprite_evals;
+    unsigned long int sprites_found;
+} MNCounters;
+
 typedef struct {
     MNCPU cpu;
     MNPPU ppu;
@@ -220,9 +334,43 @@ typedef struct {
 
     MNMapper mapper;
 
+    MNTrace trace;
+
+#if MN_CONFIG_COUNTERS
+    /* Counters of the frame being emulated and of the last full frame */
+    MNCounters counters;
+    MNCounters frame_counters;
+#endif
+
+    /* Set to skip the pixel output, for frames that are not displayed */
+    int skip_video;
+
+    /* The last frame that was output. It is not part of the snapshots. */
+    MNFrame frame;
+
     int pal;
 } MNEmu;
 
+/* The state of the emulator at some point in time. A snapshot can only be
+ * loaded back into the emulator it was saved from. */
+typedef struct {
+    MNCPU cpu;
+    MNPPU ppu;
+    MNAPU apu;
+    MNDMA dma;
+
+    MNCtrl ctrl1;
+    MNCtrl ctrl2;
+
+#if MN_CONFIG_COUNTERS
+    MNCounters counters;
+    MNCounters frame_counters;
+#endif
+
+    /* Saved by the mapper */
+    unsigned char *mapper;
+} MNSnapshot;
+
 enum {
     MN_EMU_E_NONE,
     MN_EMU_E_CPU,
@@ -235,12 +383,17 @@ enum {
     MN_EMU_E_AMOUNT
 };
 
-int mn_emu_init(MNEmu *emu, void draw_pixel(long int color),
-                unsigned char player1_input(), unsigned char player2_input(),
-                MNCtrl ctrl1_type, MNCtrl ctrl2_type, unsigned char *rom,
-                unsigned char *palette, size_t size, int pal);
+int mn_emu_init(MNEmu *emu, unsigned char player1_input(),
+                unsigned char player2_input(), MNCtrl ctrl1_type,
+                MNCtrl ctrl2_type, unsigned char *rom, unsigned char *palette,
+                size_t size, int pal);
 void mn_emu_pixel(MNEmu *emu);
 void mn_emu_frame(MNEmu *emu);
+int mn_emu_get_counters(MNEmu *emu, MNCounters *counters);
+int mn_emu_snapshot_init(MNEmu *emu, MNSnapshot *snapshot);
+void mn_emu_save_state(MNEmu *emu, MNSnapshot *snapshot);
+void mn_emu_load_state(MNEmu *emu, MNSnapshot *snapshot);
+void mn_emu_snapshot_free(MNSnapshot *snapshot);
 void mn_emu_free(MNEmu *emu);
 
 #endif /* MN_EMU_H */
@@ -0,0 +1,188 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <frame.h>
+
+#include <string.h>
+
+#if MN_CONFIG_SIMD && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define MN_FRAME_X86 1
+#include <immintrin.h>
+#elif MN_FRAME_NEON
+#include <arm_neon.h>
+#endif
+
+/* The pixels are stored as 32-bit values */
+typedef char mn_frame_check_pixel_size[sizeof(unsigned int) == 4 ? 1 : -1];
+
+typedef void MNFrameKernel(unsigned int *out, unsigned char *pixels,
+                           MNFrame *frame, unsigned char emphasis);
+
+static void mn_frame_scalar(unsigned int *out, unsigned char *pixels,
+                            MNFrame *frame, unsigned char emphasis) {
+    unsigned short int x;
+    unsigned int *colors = frame->colors[emphasis];
+
+    for(x=0;x<MN_FRAME_WIDTH;x++){
+        out[x] = colors[pixels[x]];
+    }
+}
+
+#if MN_FRAME_X86
+
+__attribute__((target("avx2")))
+static void mn_frame_avx2(unsigned int *out, unsigned char *pixels,
+                          MNFrame *frame, unsigned char emphasis) {
+    unsigned short int x;
+    int *colors = (int*)frame->colors[emphasis];
+    __m256i idx;
+
+    for(x=0;x<MN_FRAME_WIDTH;x+=8){
+        idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(pixels+x)));
+        _mm256_storeu_si256((__m256i*)(out+x),
+                            _mm256_i32gather_epi32(colors, idx, 4));
+    }
+}
+
+#endif
+
+#if MN_FRAME_NEON
+
+static void mn_frame_neon(unsigned int *out, unsigned char *pixels,
+                          MNFrame *frame, unsigned char emphasis) {
+    unsigned short int x;
+    uint8x16x4_t tables[3];
+    uint8x16x4_t color;
+    uint8x16_t idx;
+    int i;
+
+    for(i=0;i<3;i++){
+        tables[i].val[0] = vld1q_u8(frame->planes[emphasis][i]);
+        tables[i].val[1] = vld1q_u8(frame->planes[emphasis][i]+16);
+        tables[i].val[2] = vld1q_u8(frame->planes[emphasis][i]+32);
+        tables[i].val[3] = vld1q_u8(frame->planes[emphasis][i]+48);
+    }
+
+    color.val[3] = vdupq_n_u8(0);
+
+    for(x=0;x<MN_FRAME_WIDTH;x+=16){
+        idx = vld1q_u8(pixels+x);
+        /* Little endian 0x00RRGGBB is stored as blue, green, red, 0 */
+        color.val[0] = vqtbl4q_u8(tables[2], idx);
+        color.val[1] = vqtbl4q_u8(tables[1], idx);
+        color.val[2] = vqtbl4q_u8(tables[0], idx);
+        vst4q_u8((unsigned char*)(out+x), color);
+    }
+}
+
+#endif
+
+static MNFrameKernel *mn_frame_kernel_func = mn_frame_scalar;
+static const char *mn_frame_kernel_name = "scalar";
+
+int mn_frame_init(MNFrame *frame, unsigned char *palette) {
+    unsigned char emphasis;
+    unsigned char i;
+    unsigned char *color;
+
+    memset(frame->pixels, 0, sizeof(frame->pixels));
+    memset(frame->lines, 0, sizeof(frame->lines));
+    memset(frame->emphasis, 0, sizeof(frame->emphasis));
+
+    for(emphasis=0;emphasis<8;emphasis++){
+        for(i=0;i<64;i++){
+            /* The palette contains 64 colors for each combination of the
+             * emphasis bits. */
+            color = palette+(emphasis*64+i)*3;
+            frame->colors[emphasis][i] = ((unsigned int)color[0]<<16)|
+                                     (color[1]<<8)|color[2];
+#if MN_FRAME_NEON
+            frame->planes[emphasis][0][i] = color[0];
+            frame->planes[emphasis][1][i] = color[1];
+            frame->planes[emphasis][2][i] = color[2];
+#endif
+        }
+    }
+
+#if MN_FRAME_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        mn_frame_kernel_func = mn_frame_avx2;
+        mn_frame_kernel_name = "avx2";
+    }
+#elif MN_FRAME_NEON
+    mn_frame_kernel_func = mn_frame_neon;
+    mn_frame_kernel_name = "neon";
+#endif
+
+    return 0;
+}
+
+void mn_frame_set_emphasis(MNFrame *frame, unsigned char y,
+                           unsigned short int x, unsigned char emphasis) {
+    if(!x){
+        frame->lines[y] = emphasis;
+        return;
+    }
+
+    if(!(frame->lines[y]&MN_FRAME_MIXED)){
+        if(frame->lines[y] == emphasis) return;
+
+        memset(frame->emphasis[y], frame->lines[y], x);
+        frame->lines[y] = MN_FRAME_MIXED;
+    }
+
+    memset(frame->emphasis[y]+x, emphasis, MN_FRAME_WIDTH-x);
+}
+
+void mn_frame_convert(MNFrame *frame, unsigned int *out) {
+    unsigned short int x, y;
+
+    for(y=0;y<MN_FRAME_HEIGHT;y++,out+=MN_FRAME_WIDTH){
+        if(frame->lines[y]&MN_FRAME_MIXED){
+            for(x=0;x<MN_FRAME_WIDTH;x++){
+                out[x] = frame->colors[frame->emphasis[y][x]]
+                                      [frame->pixels[y][x]];
+            }
+        }else{
+            mn_frame_kernel_func(out, frame->pixels[y], frame,
+                                 frame->lines[y]);
+        }
+    }
+}
+
+const char *mn_frame_kernel(void) {
+    return mn_frame_kernel_name;
+}
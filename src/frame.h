@@ -0,0 +1,84 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MN_FRAME_H
+#define MN_FRAME_H
+
+#include <config.h>
+
+#if MN_CONFIG_SIMD && defined(__GNUC__) && defined(__aarch64__) && \
+    defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MN_FRAME_NEON 1
+#endif
+
+#define MN_FRAME_WIDTH  256
+#define MN_FRAME_HEIGHT 240
+
+/* Get the emphasis bits of a line from PPUMASK */
+#define MN_FRAME_EMPHASIS(mask) (((mask)>>5)&7)
+/* Set instead of the emphasis bits of a line when they change in the middle
+ * of it. They are then stored for each pixel of the line. */
+#define MN_FRAME_MIXED 8
+
+/* A picture as it is output by the PPU: the palette RAM value of each pixel,
+ * with grayscale already applied, and the emphasis bits of each line. It is
+ * only converted to RGB when it is displayed. */
+typedef struct {
+    unsigned char pixels[MN_FRAME_HEIGHT][MN_FRAME_WIDTH];
+    unsigned char lines[MN_FRAME_HEIGHT];
+    unsigned char emphasis[MN_FRAME_HEIGHT][MN_FRAME_WIDTH];
+
+    /* The colors of the 64 palette values for each combination of the
+     * emphasis bits, as 0x00RRGGBB. */
+    unsigned int colors[8][64];
+#if MN_FRAME_NEON
+    /* The same colors, as separate red, green and blue tables */
+    unsigned char planes[8][3][64];
+#endif
+} MNFrame;
+
+int mn_frame_init(MNFrame *frame, unsigned char *palette);
+
+/* Change the emphasis bits of line y from pixel x onwards */
+void mn_frame_set_emphasis(MNFrame *frame, unsigned char y,
+                           unsigned short int x, unsigned char emphasis);
+
+/* Convert the frame to 32-bit 0x00RRGGBB pixels. It only contains a full
+ * picture after a frame that was emulated with skip_video unset. */
+void mn_frame_convert(MNFrame *frame, unsigned int *out);
+
+/* The name of the kernel in use */
+const char *mn_frame_kernel(void);
+
+#endif /* MN_FRAME_H */
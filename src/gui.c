@@ -32,26 +32,66 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _XOPEN_SOURCE 600
+
 #include <gui.h>
 
 #include <emu.h>
 
-#define _XOPEN_SOURCE 600
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
+#include <X11/extensions/XShm.h>
 
 #include <prof.h>
+#include <telemetry.h>
+
+#include <trace.h>
+
+#include <pacing.h>
+#include <tribuf.h>
 
 #define W 256
 #define H 240
 
 #define BUTTON_NUM 8
 
+/* The back buffer is allocated for sizes rounded up to this, so that it can
+ * be reused when the window is slightly resized */
+#define MN_GUI_ROUND_SIZE(v) (((v)+63)&~63)
+
+/* The frames and the back buffer are accessed as 32-bit pixels */
+typedef char mn_gui_check_pixel_size[sizeof(unsigned int) == 4 ? 1 : -1];
+
+#define TRACE_KEY XK_F9
+#define TRACE_FILE "mibines.trace"
+
+#define RUN_AHEAD_KEY XK_F8
+#define RUN_AHEAD_MAX 3
+
+/* While the turbo key is held, only one frame out of TURBO_SPEED is
+ * displayed */
+#define TURBO_KEY XK_Tab
+#define TURBO_SPEED 8
+
+/* Maximum amount of frames that are skipped in a row when the emulator can't
+ * keep up */
+#define FRAMESKIP_MAX 3
+
+/* Requests sent from the X11 thread to the emulation thread */
+#define MN_GUI_REQUEST_TRACE     1
+#define MN_GUI_REQUEST_RUN_AHEAD 2
+
 #define MN_GUI_DUMP_CPU() \
     { \
         size_t i, n; \
@@ -88,6 +128,8 @@
         } \
     }
 
+/* Owned by the X11 thread */
+
 static Display *display;
 static Window root;
 static Window window;
@@ -98,16 +140,59 @@ static XVisualInfo info;
 
 static char *back_buffer;
 static XImage *back_buffer_image;
+/* Size of the allocation of the back buffer in bytes */
+static size_t capacity;
+
+/* If MIT-SHM is available the back buffer is shared with the X server, which
+ * avoids copying it over the socket */
+static int use_shm;
+static XShmSegmentInfo shm_info;
+static int shm_completion;
+/* The back buffer can't be modified until the X server is done with it */
+static int shm_pending;
+static int shm_error;
 
-static MNEmu emu;
-
-static int x, y;
 static int w, h;
 
+/* Position of each column and row of the frame in the back buffer, the last
+ * entries are the end of the image */
+static int col_map[W+1];
+static int row_map[H+1];
+
+/* The frame always covers the same area of the back buffer, so only the
+ * border around it has to be cleared, and only when the maps change */
+static int border_dirty;
+
 static int needs_resize;
 static int nw, nh;
 
-static unsigned long int last_time;
+/* Owned by the emulation thread */
+
+static MNEmu emu;
+
+static MNPacing pacing;
+
+/* Amount of frames emulated ahead of the displayed one */
+static int run_ahead;
+static MNSnapshot snapshot;
+
+/* Shared between both threads */
+
+static MNTriBuf frames;
+
+static pthread_t emu_thread;
+
+/* Only accessed atomically */
+static int running;
+/* The buttons of player 1 are in the low byte, those of player 2 in the next
+ * one */
+static unsigned int buttons;
+static unsigned int requests;
+static int turbo;
+
+/* Written to by the emulation thread to wake up the X11 thread when a new
+ * frame is ready */
+static int wake_pipe[2];
 
 static int keys1[BUTTON_NUM] = {
     XK_e,
@@ -131,29 +216,37 @@ static int keys2[BUTTON_NUM] = {
     XK_k
 };
 
-static unsigned char buttons1 = 0;
-static unsigned char buttons2 = 0;
+#if MN_CONFIG_TRACE
+static void mn_gui_toggle_trace(void) {
+    FILE *fp;
 
-static unsigned long mn_gui_get_time(void) {
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    return time.tv_nsec/(1e6)+time.tv_sec*1000;
-}
+    if(!emu.trace.enabled){
+        if(mn_trace_start(&emu.trace, MN_CONFIG_TRACE_SIZE)){
+            fputs("Failed to start tracing!\n", stderr);
+            return;
+        }
+        fputs("Tracing started.\n", stderr);
+        return;
+    }
+
+    mn_trace_stop(&emu.trace);
 
-#if MN_CONFIG_PROF
-unsigned long mn_gui_get_ns(void) {
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    return time.tv_nsec+time.tv_sec*(unsigned long int)1e9;
+    fp = fopen(TRACE_FILE, "wb");
+    if(fp == NULL || mn_trace_save(&emu.trace, fp)){
+        fputs("Failed to save the trace to \"" TRACE_FILE "\"!\n", stderr);
+    }else{
+        fputs("Trace saved to \"" TRACE_FILE "\".\n", stderr);
+    }
+    if(fp != NULL) fclose(fp);
 }
 #endif
 
 static unsigned char mn_gui_player1_buttons(void) {
-    return buttons1;
+    return __atomic_load_n(&buttons, __ATOMIC_RELAXED)&0xFF;
 }
 
 static unsigned char mn_gui_player2_buttons(void) {
-    return buttons2;
+    return (__atomic_load_n(&buttons, __ATOMIC_RELAXED)>>8)&0xFF;
 }
 
 /* The ratio of the screen as a fraction (numerator/denominator) */
@@ -162,6 +255,145 @@ static int ratio_denom = 5;
 
 extern MNCtrl mn_nesctrl;
 
+/* Compute where each pixel of the frame ends up in the back buffer */
+static void mn_gui_update_maps(void) {
+    size_t i;
+
+    int tw = w, th = h;
+
+    if(th*ratio_num/ratio_denom < tw){
+        tw = th*ratio_num/ratio_denom;
+    }else{
+        th = tw*ratio_denom/ratio_num;
+    }
+
+    for(i=0;i<=W;i++){
+        col_map[i] = (w-tw)/2+i*tw/W;
+    }
+    for(i=0;i<=H;i++){
+        row_map[i] = (h-th)/2+i*th/H;
+    }
+
+    border_dirty = 1;
+}
+
+static int mn_gui_shm_error_handler(Display *display, XErrorEvent *error) {
+    (void)display;
+    (void)error;
+
+    shm_error = 1;
+
+    return 0;
+}
+
+static int mn_gui_create_shm_image(int width, int height, size_t size) {
+    int (*old_handler)(Display*, XErrorEvent*);
+
+    back_buffer_image = XShmCreateImage(display, info.visual, info.depth,
+                                        ZPixmap, NULL, &shm_info, width,
+                                        height);
+    if(back_buffer_image == NULL) return 1;
+
+    shm_info.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if(shm_info.shmid < 0){
+        XDestroyImage(back_buffer_image);
+
+        return 1;
+    }
+
+    shm_info.shmaddr = shmat(shm_info.shmid, NULL, 0);
+    if(shm_info.shmaddr == (char*)-1){
+        shmctl(shm_info.shmid, IPC_RMID, NULL);
+        XDestroyImage(back_buffer_image);
+
+        return 1;
+    }
+
+    back_buffer_image->data = shm_info.shmaddr;
+    shm_info.readOnly = False;
+
+    /* Attaching fails asynchronously if the X server can't access our shared
+     * memory, for example when it is running on another machine */
+    shm_error = 0;
+    old_handler = XSetErrorHandler(mn_gui_shm_error_handler);
+    XShmAttach(display, &shm_info);
+    XSync(display, False);
+    XSetErrorHandler(old_handler);
+
+    /* The segment gets destroyed once both of us detached from it */
+    shmctl(shm_info.shmid, IPC_RMID, NULL);
+
+    if(shm_error){
+        shmdt(shm_info.shmaddr);
+        back_buffer_image->data = NULL;
+        XDestroyImage(back_buffer_image);
+
+        return 1;
+    }
+
+    back_buffer = shm_info.shmaddr;
+
+    return 0;
+}
+
+/* Create the back buffer, back_buffer is NULL on failure */
+static void mn_gui_create_image(int width, int height) {
+    capacity = MN_GUI_ROUND_SIZE(width)*MN_GUI_ROUND_SIZE(height)*4;
+
+    if(use_shm){
+        if(!mn_gui_create_shm_image(width, height, capacity)) return;
+
+        fputs("Failed to use MIT-SHM, falling back to XPutImage.\n", stderr);
+        use_shm = 0;
+    }
+
+    back_buffer = malloc(capacity);
+    if(back_buffer != NULL){
+        back_buffer_image = XCreateImage(display, info.visual, info.depth,
+                                         ZPixmap, 0, back_buffer, width,
+                                         height, 4*8, 0);
+    }
+}
+
+static void mn_gui_destroy_image(void) {
+    if(back_buffer == NULL) return;
+
+    if(use_shm){
+        XShmDetach(display, &shm_info);
+        shmdt(shm_info.shmaddr);
+        back_buffer_image->data = NULL;
+    }
+    /* NOTE: XDestroyImage also frees back_buffer if it isn't shared. */
+    XDestroyImage(back_buffer_image);
+    back_buffer = NULL;
+}
+
+/* Resize the back buffer, reusing the current allocation if it is big
+ * enough */
+static void mn_gui_resize_image(int width, int height) {
+    XImage *image;
+
+    if(back_buffer != NULL && (size_t)width*height*4 <= capacity){
+        if(use_shm){
+            image = XShmCreateImage(display, info.visual, info.depth, ZPixmap,
+                                    back_buffer, &shm_info, width, height);
+        }else{
+            image = XCreateImage(display, info.visual, info.depth, ZPixmap, 0,
+                                 back_buffer, width, height, 4*8, 0);
+        }
+        if(image != NULL){
+            back_buffer_image->data = NULL;
+            XDestroyImage(back_buffer_image);
+            back_buffer_image = image;
+
+            return;
+        }
+    }
+
+    mn_gui_destroy_image();
+    mn_gui_create_image(width, height);
+}
+
 int mn_gui_init(unsigned char *rom, unsigned char *palette, size_t size) {
     int rc;
 
@@ -173,17 +405,14 @@ int mn_gui_init(unsigned char *rom, unsigned char *palette, size_t size) {
     nh = h;
     needs_resize = 0;
 
-    last_time = mn_gui_get_time();
-
-    if((rc = mn_emu_init(&emu, mn_gui_pixel, mn_gui_player1_buttons,
+    if((rc = mn_emu_init(&emu, mn_gui_player1_buttons,
                          mn_gui_player2_buttons, mn_nesctrl, mn_nesctrl, rom,
                          palette, size, 0))){
         printf("Failed initialization with error %d!\n", rc);
         return 1;
     }
 
-    back_buffer = malloc(W*H*4);
-    if(back_buffer == NULL){
+    if(mn_tribuf_init(&frames, W*H*4)){
         mn_emu_free(&emu);
 
         return 2;
@@ -194,7 +423,7 @@ int mn_gui_init(unsigned char *rom, unsigned char *palette, size_t size) {
     display = XOpenDisplay(NULL);
     if(display == NULL){
         mn_emu_free(&emu);
-        free(back_buffer);
+        mn_tribuf_free(&frames);
 
         return 3;
     }
@@ -204,12 +433,27 @@ int mn_gui_init(unsigned char *rom, unsigned char *palette, size_t size) {
     if(!XMatchVisualInfo(display, DefaultScreen(display), 24, TrueColor,
                          &info)){
         mn_emu_free(&emu);
-        free(back_buffer);
+        mn_tribuf_free(&frames);
         XCloseDisplay(display);
 
         return 4;
     }
 
+    use_shm = XShmQueryExtension(display);
+    if(use_shm){
+        shm_completion = XShmGetEventBase(display)+ShmCompletion;
+    }
+    shm_pending = 0;
+
+    mn_gui_create_image(W, H);
+    if(back_buffer == NULL){
+        mn_emu_free(&emu);
+        mn_tribuf_free(&frames);
+        XCloseDisplay(display);
+
+        return 2;
+    }
+
     attr.background_pixel = 0;
     attr.colormap = XCreateColormap(display, root, info.visual, AllocNone);
 
@@ -219,9 +463,8 @@ int mn_gui_init(unsigned char *rom, unsigned char *palette, size_t size) {
 
     /* TODO: Error handling */
 
-    XSelectInput(display, window, ExposureMask | ButtonPressMask |
-                 ButtonReleaseMask | PointerMotionMask | KeyPressMask |
-                 KeyReleaseMask | KeymapStateMask);
+    XSelectInput(display, window, StructureNotifyMask | KeyPressMask |
+                 KeyReleaseMask);
 
     /* Make the window appear */
     XMapWindow(display, window);
@@ -234,13 +477,14 @@ int mn_gui_init(unsigned char *rom, unsigned char *palette, size_t size) {
 
     gc = DefaultGC(display, DefaultScreen(display));
 
-    back_buffer_image = XCreateImage(display, info.visual, info.depth, ZPixmap,
-                                     0, back_buffer, W, H, 4*8, 0);
+    mn_gui_update_maps();
 
-    x = 0;
-    y = 0;
+    buttons = 0;
+    requests = 0;
+    turbo = 0;
 
     MN_PROF_INIT();
+    MN_TELEMETRY_INIT();
 
     return 0;
 }
@@ -256,197 +500,388 @@ static int mn_gui_get_next_event(void) {
     return 0;
 }
 
-static void mn_gui_update(void) {
-    unsigned long int new_time;
-    unsigned long int ms;
+/* Scale the last frame to the back buffer */
+static void mn_gui_draw_frame(void) {
+    size_t fx, fy;
+    int px, py;
+    unsigned int color;
+    unsigned int *row;
+    unsigned int *p;
 
-    if(back_buffer != NULL){
-        XPutImage(display, window, gc, back_buffer_image, 0, 0, 0, 0, w, h);
+    unsigned int *frame = (unsigned int*)MN_TRIBUF_READ_BUFFER(&frames);
+
+    if(back_buffer == NULL){
+        /* Fallback on error */
+        for(fy=0;fy<H;fy++){
+            for(fx=0;fx<W;fx++){
+                p = frame+fy*W+fx;
+                XSetForeground(display, gc, *p);
+                XFillRectangle(display, window, gc, col_map[fx], row_map[fy],
+                               col_map[fx+1]-col_map[fx],
+                               row_map[fy+1]-row_map[fy]);
+            }
+        }
+
+        return;
     }
 
-    if(needs_resize){
-        /* NOTE: XDestroyImage also frees back_buffer. */
-        if(back_buffer != NULL) XDestroyImage(back_buffer_image);
-        back_buffer = malloc(nw*nh*4);
-        if(back_buffer != NULL){
-            back_buffer_image = XCreateImage(display, info.visual, info.depth,
-                                             ZPixmap, 0, back_buffer, nw, nh,
-                                             4*8, 0);
+    for(fy=0;fy<H;fy++){
+        if(row_map[fy] == row_map[fy+1]) continue;
+
+        /* Scale the first row horizontally */
+        row = (unsigned int*)back_buffer+row_map[fy]*w;
+        for(fx=0;fx<W;fx++){
+            color = frame[fy*W+fx];
+            p = row+col_map[fx];
+            for(px=col_map[fx];px<col_map[fx+1];px++){
+                *(p++) = color;
+            }
+        }
+
+        /* And copy it for the others */
+        for(py=row_map[fy]+1;py<row_map[fy+1];py++){
+            memcpy((unsigned int*)back_buffer+py*w+col_map[0],
+                   row+col_map[0], (col_map[W]-col_map[0])*4);
         }
+    }
+}
+
+static void mn_gui_clear(int cx, int cy, int cw, int ch) {
+    int py;
+
+    for(py=cy;py<cy+ch;py++){
+        memset(back_buffer+(py*w+cx)*4, 0, cw*4);
+    }
+}
+
+/* Clear the letterbox border around the frame */
+static void mn_gui_clear_border(void) {
+    int left = col_map[0];
+    int right = col_map[W];
+    int top = row_map[0];
+    int bottom = row_map[H];
+
+    mn_gui_clear(0, 0, w, top);
+    mn_gui_clear(0, bottom, w, h-bottom);
+    mn_gui_clear(0, top, left, bottom-top);
+    mn_gui_clear(right, top, w-right, bottom-top);
+}
+
+static void mn_gui_present(void) {
+    MN_TELEMETRY_START(MN_TELEMETRY_PRESENT);
+
+    if(needs_resize){
+        mn_gui_resize_image(nw, nh);
 
         w = nw;
         h = nh;
 
+        mn_gui_update_maps();
+
         needs_resize = 0;
     }
 
-    memset(back_buffer, 0, w*h*4);
-
-    /* Cap it at 16 ms */
-    do{
-        new_time = mn_gui_get_time();
-        ms = new_time-last_time;
-        if(new_time < last_time) ms = 1;
-    }while(ms < 16);
+    if(back_buffer != NULL && border_dirty){
+        mn_gui_clear_border();
+        border_dirty = 0;
+    }
 
-    last_time = new_time;
+    mn_gui_draw_frame();
 
-#if 0
-    printf("\033[2Kms: %lu\r", ms);
-#endif
-    fflush(stdout);
+    if(back_buffer != NULL){
+        if(use_shm){
+            XShmPutImage(display, window, gc, back_buffer_image, 0, 0, 0, 0,
+                         w, h, True);
+            shm_pending = 1;
+        }else{
+            XPutImage(display, window, gc, back_buffer_image, 0, 0, 0, 0, w,
+                      h);
+        }
+    }
 
     XFlush(display);
-}
 
-static void mn_gui_rect(int x, int y, int rw, int rh, long int color) {
-    int px, py;
-    char *p;
-    size_t d;
-
-    char r = *((unsigned char*)&color);
-    char g = ((unsigned char*)&color)[1];
-    char b = ((unsigned char*)&color)[2];
+    MN_TELEMETRY_STOP(MN_TELEMETRY_PRESENT);
+}
 
-    if(back_buffer == NULL){
-        /* Fallback on error */
-        XSetForeground(display, gc, color);
-        XFillRectangle(display, window, gc, x, y, rw, rh);
-    }else{
-        if(x < 0){
-            rw += x;
-            x = 0;
-        }
-        if(y < 0){
-            rh += y;
-            y = 0;
-        }
-        if(x+rw > w){
-            rw = w-x-1;
-        }
-        if(rw < 0 || x >= w){
-            return;
-        }
-        if(y+rh > h){
-            rh = h-y-1;
-        }
-        if(rh < 0 || y >= h){
+static void mn_gui_cycle_run_ahead(void) {
+    if(!run_ahead && snapshot.mapper == NULL){
+        if(mn_emu_snapshot_init(&emu, &snapshot)){
+            fputs("Failed to enable run-ahead!\n", stderr);
             return;
         }
+    }
 
-        p = back_buffer+(y*w+x)*4;
-        d = (w-rw)*4;
-        for(py=y;py<y+rh;py++){
-            for(px=x;px<x+rw;px++){
-                *(p++) = r;
-                *(p++) = g;
-                *(p++) = b;
-                *(p++) = 0;
-            }
-            p += d;
-        }
+    run_ahead = (run_ahead+1)%(RUN_AHEAD_MAX+1);
+    fprintf(stderr, "Run-ahead: %d frame(s).\n", run_ahead);
+}
+
+/* Emulate a frame, and display it if show is set */
+static void mn_gui_run_frame(int show) {
+    int i;
+    int tracing;
+
+    if(!run_ahead || !show){
+        emu.skip_video = !show;
+        mn_emu_frame(&emu);
+        emu.skip_video = 0;
+        return;
+    }
+
+    /* Emulate the real frame without displaying it */
+    emu.skip_video = 1;
+    mn_emu_frame(&emu);
+    mn_emu_save_state(&emu, &snapshot);
+
+    /* Display the frame that comes run_ahead frames later with the current
+     * input, to hide the input lag of the game, and go back */
+    tracing = emu.trace.enabled;
+    emu.trace.enabled = 0;
+    for(i=0;i<run_ahead;i++){
+        emu.skip_video = i < run_ahead-1;
+        mn_emu_frame(&emu);
     }
+    emu.trace.enabled = tracing;
+    emu.skip_video = 0;
+
+    mn_emu_load_state(&emu, &snapshot);
 }
 
-void mn_gui_pixel(long int color) {
-    /* HACK: I had to add 1 to the width and height to avoid having a black
-     * grid */
+static void *mn_gui_emulate(void *arg) {
+    int message = 0;
+    unsigned int new_requests;
+    int i;
+    /* Amount of frames skipped in a row because we were late */
+    int skipped = 0;
+    int late = 0;
 
-    register int rx, ry;
-    register int rw, rh;
+    (void)arg;
 
-    register int tw = w, th = h;
+    mn_pacing_init(&pacing, emu.pal);
 
-    if(th*ratio_num/ratio_denom < tw){
-        tw = th*ratio_num/ratio_denom;
-    }else{
-        th = tw*ratio_denom/ratio_num;
-    }
+    run_ahead = 0;
+    snapshot.mapper = NULL;
+
+    MN_TELEMETRY_START(MN_TELEMETRY_EMU);
+
+    while(__atomic_load_n(&running, __ATOMIC_RELAXED)){
+        new_requests = __atomic_exchange_n(&requests, 0, __ATOMIC_ACQUIRE);
+#if MN_CONFIG_TRACE
+        if(new_requests & MN_GUI_REQUEST_TRACE) mn_gui_toggle_trace();
+#endif
+        if(new_requests & MN_GUI_REQUEST_RUN_AHEAD){
+            mn_gui_cycle_run_ahead();
+        }
 
-    rx = x*tw/W;
-    ry = y*th/H;
-    rw = tw/W+1;
-    rh = th/H+1;
+        if(__atomic_load_n(&turbo, __ATOMIC_RELAXED)){
+            emu.skip_video = 1;
+            for(i=1;i<TURBO_SPEED;i++) mn_emu_frame(&emu);
+            emu.skip_video = 0;
+        }
 
-    rx += (w-tw)/2;
-    ry += (h-th)/2;
+        /* If the last frame missed its deadline, try to catch up by not
+         * displaying this one. */
+        if(late && skipped < FRAMESKIP_MAX){
+            skipped++;
+            mn_gui_run_frame(0);
+        }else{
+            skipped = 0;
+            mn_gui_run_frame(1);
+            mn_frame_convert(&emu.frame,
+                             (unsigned int*)MN_TRIBUF_WRITE_BUFFER(&frames));
+
+            mn_tribuf_publish(&frames);
+            /* If the pipe is full the X11 thread will wake up anyway */
+            write(wake_pipe[1], "", 1);
+        }
 
-    mn_gui_rect(rx, ry, rw, rh, color);
+        MN_TELEMETRY_STOP(MN_TELEMETRY_EMU);
 
-    x++;
-    if(x >= W){
-        x = 0;
-        y++;
-        if(y >= H){
-            y = 0;
+        MN_TELEMETRY_START(MN_TELEMETRY_WAIT);
+        late = mn_pacing_wait(&pacing);
+        MN_TELEMETRY_STOP(MN_TELEMETRY_WAIT);
 
-            mn_gui_update();
+        MN_TELEMETRY_START(MN_TELEMETRY_EMU);
+
+        if(emu.cpu.jammed && !message){
+            fprintf(stderr, "CPU jammed! opcode: %02x pc: %04x\n",
+                    emu.cpu.opcode, emu.cpu.pc);
+            message = 1;
         }
     }
-}
 
-void mn_gui_run(void) {
-    int message = 0;
+    mn_emu_snapshot_free(&snapshot);
+
+    return NULL;
+}
 
-    XWindowAttributes win_attr;
+/* Returns 1 when the window got closed */
+static int mn_gui_handle_event(void) {
+    int keysym;
+    size_t i;
 
-    while(1){
-        if(mn_gui_get_next_event()){
-            if((Atom)event.xclient.data.l[0] == wm_delete){
-                break;
+    if(event.type == ClientMessage &&
+       (Atom)event.xclient.data.l[0] == wm_delete){
+        return 1;
+    }
+    if(use_shm && event.type == shm_completion){
+        shm_pending = 0;
+    }else if(event.type == ConfigureNotify){
+        /* Only the last one of a burst matters */
+        while(XCheckTypedWindowEvent(display, window, ConfigureNotify,
+                                     &event));
+        nw = event.xconfigure.width;
+        nh = event.xconfigure.height;
+        needs_resize = nw != w || nh != h;
+    }else if(event.type == KeyPress){
+        keysym = XLookupKeysym(&event.xkey, 0);
+        if(keysym == TURBO_KEY){
+            __atomic_store_n(&turbo, 1, __ATOMIC_RELAXED);
+        }
+        if(keysym == RUN_AHEAD_KEY){
+            __atomic_fetch_or(&requests, MN_GUI_REQUEST_RUN_AHEAD,
+                              __ATOMIC_RELEASE);
+        }
+#if MN_CONFIG_TRACE
+        if(keysym == TRACE_KEY){
+            __atomic_fetch_or(&requests, MN_GUI_REQUEST_TRACE,
+                              __ATOMIC_RELEASE);
+        }
+#endif
+        for(i=0;i<BUTTON_NUM;i++){
+            if(keysym == keys1[i]){
+                __atomic_fetch_or(&buttons, 1<<i, __ATOMIC_RELAXED);
             }
-            if(event.type == Expose){
-                XGetWindowAttributes(display, window, &win_attr);
-                nw = win_attr.width;
-                nh = win_attr.height;
-                needs_resize = 1;
-            }else if(event.type == KeyPress){
-                int keysym;
-                size_t i;
-
-                keysym = XLookupKeysym(&event.xkey, 0);
-                for(i=0;i<BUTTON_NUM;i++){
-                    if(keysym == keys1[i]){
-                        buttons1 |= 1<<i;
-                    }
-                    if(keysym == keys2[i]){
-                        buttons2 |= 1<<i;
-                    }
-                }
-            }else if(event.type == KeyRelease){
-                int keysym;
-                size_t i;
-
-                keysym = XLookupKeysym(&event.xkey, 0);
-                for(i=0;i<BUTTON_NUM;i++){
-                    if(keysym == keys1[i]){
-                        buttons1 &= ~(1<<i);
-                    }
-                    if(keysym == keys2[i]){
-                        buttons2 |= ~(1<<i);
-                    }
-                }
+            if(keysym == keys2[i]){
+                __atomic_fetch_or(&buttons, 1<<(i+8), __ATOMIC_RELAXED);
             }
-        }else{
-            mn_emu_frame(&emu);
-            if(emu.cpu.jammed && !message){
-                fprintf(stderr, "CPU jammed! opcode: %02x pc: %04x\n",
-                        emu.cpu.opcode, emu.cpu.pc);
-                message = 1;
+        }
+    }else if(event.type == KeyRelease){
+        keysym = XLookupKeysym(&event.xkey, 0);
+        if(keysym == TURBO_KEY){
+            __atomic_store_n(&turbo, 0, __ATOMIC_RELAXED);
+        }
+        for(i=0;i<BUTTON_NUM;i++){
+            if(keysym == keys1[i]){
+                __atomic_fetch_and(&buttons, ~(1<<i), __ATOMIC_RELAXED);
+            }
+            if(keysym == keys2[i]){
+                __atomic_fetch_and(&buttons, ~(1<<(i+8)), __ATOMIC_RELAXED);
             }
         }
     }
+
+    return 0;
+}
+
+void mn_gui_run(void) {
+    struct pollfd fds[2];
+    char buffer[64];
+    int quit = 0;
+
+    if(pipe(wake_pipe)){
+        fputs("Failed to create the wake up pipe!\n", stderr);
+        return;
+    }
+    /* Neither thread should ever block on it */
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+    fds[0].fd = ConnectionNumber(display);
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_pipe[0];
+    fds[1].events = POLLIN;
+
+    __atomic_store_n(&running, 1, __ATOMIC_RELAXED);
+    if(pthread_create(&emu_thread, NULL, mn_gui_emulate, NULL)){
+        fputs("Failed to start the emulation thread!\n", stderr);
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        return;
+    }
+
+    while(!quit){
+        /* Handle all the pending events before presenting, so that a burst
+         * of events doesn't get spread over several frames */
+        while(!quit && mn_gui_get_next_event()){
+            quit = mn_gui_handle_event();
+        }
+        if(quit) break;
+
+        if(!shm_pending && mn_tribuf_acquire(&frames)){
+            mn_gui_present();
+            MN_TELEMETRY_POLL();
+            /* Presenting may have queued new events */
+            continue;
+        }
+
+        /* Wait for an event or a new frame */
+        if(poll(fds, 2, -1) > 0 && (fds[1].revents & POLLIN)){
+            while(read(wake_pipe[0], buffer, sizeof(buffer)) > 0);
+        }
+    }
+
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+    pthread_join(emu_thread, NULL);
+
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
 }
 
+#if MN_CONFIG_COUNTERS
+static void mn_gui_log_counters(void) {
+    MNCounters counters;
+    size_t i;
+
+    static char *const regions[MN_COUNTERS_REGION_AMOUNT] = {
+        "RAM",
+        "PPU",
+        "IO",
+        "Cart",
+        "PRG"
+    };
+
+    mn_emu_get_counters(&emu, &counters);
+
+    fputs("Events during the last frame:\n", stderr);
+    fprintf(stderr, "CPU cycles: %lu\n", counters.cpu_cycles);
+    fprintf(stderr, "Instructions: %lu\n", counters.instructions);
+    for(i=0;i<MN_COUNTERS_REGION_AMOUNT;i++){
+        fprintf(stderr, "%s reads: %lu writes: %lu\n", regions[i],
+                counters.reads[i], counters.writes[i]);
+    }
+    for(i=0;i<8;i++){
+        fprintf(stderr, "$%04lx reads: %lu writes: %lu\n", 0x2000+i,
+                counters.ppu_reads[i], counters.ppu_writes[i]);
+    }
+    fprintf(stderr, "OAM DMA stalls: %lu\n", counters.dma_stalls);
+    fprintf(stderr, "NMIs: %lu\n", counters.nmis);
+    fprintf(stderr, "Sprite evaluations: %lu (%lu sprites found)\n",
+            counters.sprite_evals, counters.sprites_found);
+}
+#endif
+
 void mn_gui_free(void) {
+    mn_gui_destroy_image();
     XDestroyWindow(display, window);
     XCloseDisplay(display);
 
+#if MN_CONFIG_TRACE
+    /* Save the trace if it is still running */
+    if(emu.trace.enabled) mn_gui_toggle_trace();
+#endif
+
 #if MN_CONFIG_GUI_CPU_DUMP
     MN_GUI_DUMP_CPU();
 #endif
 #if MN_CONFIG_GUI_PPU_DUMP
     MN_GUI_DUMP_PPU();
+#endif
+#if MN_CONFIG_COUNTERS
+    mn_gui_log_counters();
 #endif
     MN_PROF_LOG();
+    MN_TELEMETRY_LOG();
+
+    mn_tribuf_free(&frames);
 }
@@ -40,7 +40,6 @@
 #include <config.h>
 
 int mn_gui_init(unsigned char *rom, unsigned char *palette, size_t size);
-void mn_gui_pixel(long int color);
 void mn_gui_run(void);
 void mn_gui_free(void);
 
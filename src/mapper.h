@@ -39,6 +39,11 @@
 
 /* TODO: Make open bus easily accessible */
 
+/* The mapper has to keep emu->ppu.pages pointing to the memory the PPU
+ * rendering fetches read from, and update it when banking or mirroring
+ * changes. emu->ppu.rows has to point to the decoded rows of the mapped
+ * pattern tables, that have to be decoded again when CHR-RAM is written. */
+
 typedef struct {
     int (*init)(void *_emu, void *_mapper, unsigned char *rom, size_t size);
     unsigned char (*read)(void *_emu, void *_mapper, unsigned short int addr);
@@ -50,6 +55,11 @@ typedef struct {
                   unsigned char value);
     void (*reset)(void *_emu, void *_mapper);
     void (*hard_reset)(void *_emu, void *_mapper);
+    /* Save and restore the state of the cartridge. state_size returns the
+     * size of the buffer the state is saved to. */
+    size_t (*state_size)(void *_emu, void *_mapper);
+    void (*save_state)(void *_emu, void *_mapper, unsigned char *state);
+    void (*load_state)(void *_emu, void *_mapper, unsigned char *state);
     void (*free)(void *_emu, void *_mapper);
 
     void *data;
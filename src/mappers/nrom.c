@@ -40,20 +40,25 @@
 
 #include <ctrl.h>
 
+#include <counters.h>
+
 #include <stdlib.h>
+#include <string.h>
 
 #if MN_CONFIG_MAPPER_DEBUG_RW
 #include <stdio.h>
 #endif
 
 #define MN_NROM_RAM_SIZE 0x800
-#define MN_NROM_VRAM_SIZE (0x400*2+0x20)
+#define MN_NROM_VRAM_SIZE (0x400*2)
 
 typedef struct {
     unsigned char ram[MN_NROM_RAM_SIZE];
     unsigned char vram[MN_NROM_VRAM_SIZE];
     unsigned char *rom;
     unsigned char *chr;
+    /* The rows of the 512 tiles of CHR, decoded for the PPU */
+    MNTileRow rows[0x1000];
     size_t size;
     size_t prg_rom_start;
     size_t prg_rom_size;
@@ -64,6 +69,9 @@ typedef struct {
     unsigned int chr_ram : 1;
 } MNNROM;
 
+static void mn_nrom_map_pages(MNEmu *emu, MNNROM *nrom);
+static void mn_nrom_decode_rows(MNNROM *nrom);
+
 static unsigned char mn_nrom_read(void *_emu, void *_mapper,
                                   unsigned short int addr);
 
@@ -113,12 +121,46 @@ static int mn_nrom_init(void *_emu, void *_mapper, unsigned char *rom,
         return 1;
     }
 
+    mn_nrom_decode_rows(nrom);
+    mn_nrom_map_pages(emu, nrom);
+
     emu->cpu.pc = mn_nrom_read(_emu, _mapper, 0xFFFC)|
                   (mn_nrom_read(_emu, _mapper, 0xFFFD)<<8);
 
     return 0;
 }
 
+static void mn_nrom_map_pages(MNEmu *emu, MNNROM *nrom) {
+    size_t i;
+
+    for(i=0;i<8;i++){
+        emu->ppu.pages[i] = nrom->chr+i*0x400;
+        emu->ppu.rows[i] = nrom->rows+i*0x200;
+    }
+    /* $3000-$3FFF is never reached by the rendering fetches, it just mirrors
+     * the nametables. */
+    for(i=8;i<16;i++){
+        if(nrom->horizontal){
+            emu->ppu.pages[i] = nrom->vram+((i>>1)&1)*0x400;
+        }else{
+            emu->ppu.pages[i] = nrom->vram+(i&1)*0x400;
+        }
+    }
+}
+
+/* Decode the row of the tile containing the bitplane at addr */
+#define MN_NROM_DECODE_ROW(nrom, addr) \
+    mn_ppu_decode_row((nrom)->rows+((((addr)>>1)&~7)|((addr)&7)), \
+                      (nrom)->chr[(addr)&~8], (nrom)->chr[(addr)|8])
+
+static void mn_nrom_decode_rows(MNNROM *nrom) {
+    unsigned short int addr;
+
+    for(addr=0;addr<0x2000;addr++){
+        if(!(addr&8)) MN_NROM_DECODE_ROW(nrom, addr);
+    }
+}
+
 static unsigned char mn_nrom_read(void *_emu, void *_mapper,
                                   unsigned short int addr) {
     MNNROM *rom = ((MNMapper*)_mapper)->data;
@@ -128,6 +170,8 @@ static unsigned char mn_nrom_read(void *_emu, void *_mapper,
     printf("<- %04x\n", addr);
 #endif
 
+    MN_COUNT_ACCESS(emu, reads, addr);
+
     if(addr >= 0x8000){
         return (rom->bus = rom->rom[rom->prg_rom_start+(addr-0x8000)%
                                           rom->prg_rom_size]);
@@ -163,6 +207,8 @@ static void mn_nrom_write(void *_emu, void *_mapper, unsigned short int addr,
     printf("*%04x = %02x\n", addr, value);
 #endif
 
+    MN_COUNT_ACCESS(emu, writes, addr);
+
     if(addr < 0x0800){
         rom->ram[addr] = value;
         rom->bus = value;
@@ -205,11 +251,6 @@ static unsigned char mn_nrom_vram_read(void *_emu, void *_mapper,
         }else{
             return rom->vram[(addr-0x2000)&0x7FF];
         }
-    }else if(addr >= 0x3F00){
-        if(!(addr&3)){
-            return rom->vram[0x800+(addr&0xF)];
-        }
-        return rom->vram[0x800+(addr&0x1F)];
     }
 
     return emu->ppu.io_bus;
@@ -226,13 +267,9 @@ static void mn_nrom_vram_write(void *_emu, void *_mapper,
         }else{
             rom->vram[(addr-0x2000)&0x7FF] = value;
         }
-    }else if(addr >= 0x3F00){
-        if(!(addr&3)){
-            rom->vram[0x800+(addr&0xF)] = value;
-        }
-        rom->vram[0x800+(addr&0x1F)] = value;
     }else if(rom->chr_ram && addr < 0x2000){
         rom->chr[addr] = value;
+        MN_NROM_DECODE_ROW(rom, addr);
     }
 }
 
@@ -254,6 +291,48 @@ static void mn_nrom_hard_reset(void *_emu, void *_mapper) {
                   (mn_nrom_read(_emu, _mapper, 0xFFFD)<<8);
 }
 
+static size_t mn_nrom_state_size(void *_emu, void *_mapper) {
+    MNNROM *rom = ((MNMapper*)_mapper)->data;
+    (void)_emu;
+
+    return MN_NROM_RAM_SIZE+MN_NROM_VRAM_SIZE+1+(rom->chr_ram ? 0x2000 : 0);
+}
+
+static void mn_nrom_save_state(void *_emu, void *_mapper,
+                               unsigned char *state) {
+    MNNROM *rom = ((MNMapper*)_mapper)->data;
+    (void)_emu;
+
+    memcpy(state, rom->ram, MN_NROM_RAM_SIZE);
+    state += MN_NROM_RAM_SIZE;
+    memcpy(state, rom->vram, MN_NROM_VRAM_SIZE);
+    state += MN_NROM_VRAM_SIZE;
+    *(state++) = rom->bus;
+    if(rom->chr_ram) memcpy(state, rom->chr, 0x2000);
+}
+
+static void mn_nrom_load_state(void *_emu, void *_mapper,
+                               unsigned char *state) {
+    MNNROM *rom = ((MNMapper*)_mapper)->data;
+    unsigned short int addr;
+    (void)_emu;
+
+    memcpy(rom->ram, state, MN_NROM_RAM_SIZE);
+    state += MN_NROM_RAM_SIZE;
+    memcpy(rom->vram, state, MN_NROM_VRAM_SIZE);
+    state += MN_NROM_VRAM_SIZE;
+    rom->bus = *(state++);
+    if(rom->chr_ram){
+        /* Only decode the rows that changed again */
+        for(addr=0;addr<0x2000;addr++){
+            if(rom->chr[addr] != state[addr]){
+                rom->chr[addr] = state[addr];
+                MN_NROM_DECODE_ROW(rom, addr);
+            }
+        }
+    }
+}
+
 void mn_nrom_free(void *_emu, void *_mapper) {
     MNNROM *rom = ((MNMapper*)_mapper)->data;
     (void)_emu;
@@ -268,6 +347,9 @@ MNMapper mn_mapper_nrom = {
     mn_nrom_vram_write,
     mn_nrom_reset,
     mn_nrom_hard_reset,
+    mn_nrom_state_size,
+    mn_nrom_save_state,
+    mn_nrom_load_state,
     mn_nrom_free,
     NULL
 };
@@ -0,0 +1,233 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <mux.h>
+
+#include <ppu.h>
+
+#include <config.h>
+
+#include <stddef.h>
+
+#if MN_CONFIG_SIMD && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define MN_MUX_X86 1
+#include <immintrin.h>
+#elif MN_CONFIG_SIMD && defined(__ARM_NEON)
+#define MN_MUX_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define MN_MUX_PRIORITY (1<<4)
+
+/* The sprite pixel is shown if it isn't transparent, except if it is behind a
+ * background pixel that is not transparent. */
+#define MN_MUX_PIXEL(bg, sprite) \
+    (((sprite)&3) && !(((sprite)&MN_MUX_PRIORITY) && ((bg)&3)) ? \
+     ((sprite)&0xF)|MN_MUX_PRIORITY : ((bg)&3) ? (bg) : 0)
+
+typedef void MNMuxKernel(unsigned char *out, unsigned char *bg,
+                         unsigned char *sprites, int bg_on, int sprites_on,
+                         unsigned short int size);
+
+static void mn_mux_scalar(unsigned char *out, unsigned char *bg,
+                          unsigned char *sprites, int bg_on, int sprites_on,
+                          unsigned short int size) {
+    unsigned short int i;
+    unsigned char bg_pixel, sprite_pixel;
+
+    for(i=0;i<size;i++){
+        bg_pixel = bg_on ? bg[i] : 0;
+        sprite_pixel = sprites_on ? sprites[i] : 0;
+        out[i] = MN_MUX_PIXEL(bg_pixel, sprite_pixel);
+    }
+}
+
+#if MN_MUX_X86
+
+__attribute__((target("sse2")))
+static void mn_mux_sse2(unsigned char *out, unsigned char *bg,
+                        unsigned char *sprites, int bg_on, int sprites_on,
+                        unsigned short int size) {
+    unsigned short int i;
+    __m128i zero = _mm_setzero_si128();
+    __m128i three = _mm_set1_epi8(3);
+    __m128i priority = _mm_set1_epi8(MN_MUX_PRIORITY);
+    __m128i low = _mm_set1_epi8(0xF);
+    __m128i bg_mask = bg_on ? _mm_set1_epi8(-1) : zero;
+    __m128i sprites_mask = sprites_on ? _mm_set1_epi8(-1) : zero;
+    __m128i b, s, bg_clear, sprite_clear, use_bg, bg_pixel, sprite_pixel;
+
+    for(i=0;i+16<=size;i+=16){
+        b = _mm_and_si128(_mm_loadu_si128((__m128i*)(bg+i)), bg_mask);
+        s = _mm_and_si128(_mm_loadu_si128((__m128i*)(sprites+i)),
+                          sprites_mask);
+
+        bg_clear = _mm_cmpeq_epi8(_mm_and_si128(b, three), zero);
+        sprite_clear = _mm_cmpeq_epi8(_mm_and_si128(s, three), zero);
+        use_bg = _mm_or_si128(sprite_clear,
+                              _mm_andnot_si128(bg_clear,
+                                  _mm_cmpeq_epi8(_mm_and_si128(s, priority),
+                                                 priority)));
+
+        bg_pixel = _mm_andnot_si128(bg_clear, b);
+        sprite_pixel = _mm_or_si128(_mm_and_si128(s, low), priority);
+
+        _mm_storeu_si128((__m128i*)(out+i),
+                         _mm_or_si128(_mm_and_si128(use_bg, bg_pixel),
+                                      _mm_andnot_si128(use_bg,
+                                                       sprite_pixel)));
+    }
+
+    mn_mux_scalar(out+i, bg+i, sprites+i, bg_on, sprites_on, size-i);
+}
+
+__attribute__((target("avx2")))
+static void mn_mux_avx2(unsigned char *out, unsigned char *bg,
+                        unsigned char *sprites, int bg_on, int sprites_on,
+                        unsigned short int size) {
+    unsigned short int i;
+    __m256i zero = _mm256_setzero_si256();
+    __m256i three = _mm256_set1_epi8(3);
+    __m256i priority = _mm256_set1_epi8(MN_MUX_PRIORITY);
+    __m256i low = _mm256_set1_epi8(0xF);
+    __m256i bg_mask = bg_on ? _mm256_set1_epi8(-1) : zero;
+    __m256i sprites_mask = sprites_on ? _mm256_set1_epi8(-1) : zero;
+    __m256i b, s, bg_clear, sprite_clear, use_bg, bg_pixel, sprite_pixel;
+
+    for(i=0;i+32<=size;i+=32){
+        b = _mm256_and_si256(_mm256_loadu_si256((__m256i*)(bg+i)), bg_mask);
+        s = _mm256_and_si256(_mm256_loadu_si256((__m256i*)(sprites+i)),
+                             sprites_mask);
+
+        bg_clear = _mm256_cmpeq_epi8(_mm256_and_si256(b, three), zero);
+        sprite_clear = _mm256_cmpeq_epi8(_mm256_and_si256(s, three), zero);
+        use_bg = _mm256_or_si256(sprite_clear,
+                                 _mm256_andnot_si256(bg_clear,
+                                     _mm256_cmpeq_epi8(
+                                         _mm256_and_si256(s, priority),
+                                         priority)));
+
+        bg_pixel = _mm256_andnot_si256(bg_clear, b);
+        sprite_pixel = _mm256_or_si256(_mm256_and_si256(s, low), priority);
+
+        _mm256_storeu_si256((__m256i*)(out+i),
+                            _mm256_blendv_epi8(sprite_pixel, bg_pixel,
+                                               use_bg));
+    }
+
+    mn_mux_scalar(out+i, bg+i, sprites+i, bg_on, sprites_on, size-i);
+}
+
+#endif
+
+#if MN_MUX_NEON
+
+static void mn_mux_neon(unsigned char *out, unsigned char *bg,
+                        unsigned char *sprites, int bg_on, int sprites_on,
+                        unsigned short int size) {
+    unsigned short int i;
+    uint8x16_t zero = vdupq_n_u8(0);
+    uint8x16_t three = vdupq_n_u8(3);
+    uint8x16_t priority = vdupq_n_u8(MN_MUX_PRIORITY);
+    uint8x16_t low = vdupq_n_u8(0xF);
+    uint8x16_t bg_mask = vdupq_n_u8(bg_on ? 0xFF : 0);
+    uint8x16_t sprites_mask = vdupq_n_u8(sprites_on ? 0xFF : 0);
+    uint8x16_t b, s, bg_clear, sprite_clear, use_bg, bg_pixel, sprite_pixel;
+
+    for(i=0;i+16<=size;i+=16){
+        b = vandq_u8(vld1q_u8(bg+i), bg_mask);
+        s = vandq_u8(vld1q_u8(sprites+i), sprites_mask);
+
+        bg_clear = vceqq_u8(vandq_u8(b, three), zero);
+        sprite_clear = vceqq_u8(vandq_u8(s, three), zero);
+        use_bg = vorrq_u8(sprite_clear,
+                          vbicq_u8(vtstq_u8(s, priority), bg_clear));
+
+        bg_pixel = vbicq_u8(b, bg_clear);
+        sprite_pixel = vorrq_u8(vandq_u8(s, low), priority);
+
+        vst1q_u8(out+i, vbslq_u8(use_bg, bg_pixel, sprite_pixel));
+    }
+
+    mn_mux_scalar(out+i, bg+i, sprites+i, bg_on, sprites_on, size-i);
+}
+
+#endif
+
+static MNMuxKernel *mn_mux_kernel_func = mn_mux_scalar;
+static const char *mn_mux_kernel_name = "scalar";
+
+void mn_mux_init(void) {
+#if MN_MUX_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        mn_mux_kernel_func = mn_mux_avx2;
+        mn_mux_kernel_name = "avx2";
+    }else if(__builtin_cpu_supports("sse2")){
+        mn_mux_kernel_func = mn_mux_sse2;
+        mn_mux_kernel_name = "sse2";
+    }
+#elif MN_MUX_NEON
+    mn_mux_kernel_func = mn_mux_neon;
+    mn_mux_kernel_name = "neon";
+#endif
+}
+
+void mn_mux(unsigned char *out, unsigned char *bg, unsigned char *sprites,
+            unsigned char mask, unsigned short int start,
+            unsigned short int end) {
+    unsigned short int bg_start, sprites_start;
+    unsigned short int x;
+    int bg_on = mask&MN_PPU_MASK_BACKGROUND;
+    int sprites_on = mask&MN_PPU_MASK_SPRITES;
+
+    /* The leftmost pixels can be hidden. mn_ppu_cycle hides them up to dot
+     * 9. */
+    bg_start = mask&MN_PPU_MASK_BG_LEFTMOST_8PX ? 0 : 9;
+    sprites_start = mask&MN_PPU_MASK_SPRITES_LEFTMOST_8PX ? 0 : 9;
+
+    for(x=start;x<end && x<16;x++){
+        mn_mux_scalar(out+x, bg+x, sprites+x, bg_on && x >= bg_start,
+                      sprites_on && x >= sprites_start, 1);
+    }
+
+    if(x < end){
+        mn_mux_kernel_func(out+x, bg+x, sprites+x, bg_on, sprites_on, end-x);
+    }
+}
+
+const char *mn_mux_kernel(void) {
+    return mn_mux_kernel_name;
+}
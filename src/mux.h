@@ -0,0 +1,52 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MN_MUX_H
+#define MN_MUX_H
+
+/* Resolve the priority between the background and the sprites for a part of a
+ * scanline, from start to end excluded. Background pixels are a color and a
+ * palette (4 bits), sprite pixels also have the priority in bit 4. The
+ * output are palette RAM indices, with 0 for transparent pixels.
+ * The mask is the value of PPUMASK used for the whole part of the line. */
+
+void mn_mux_init(void);
+void mn_mux(unsigned char *out, unsigned char *bg, unsigned char *sprites,
+            unsigned char mask, unsigned short int start,
+            unsigned short int end);
+
+/* The name of the kernel in use */
+const char *mn_mux_kernel(void);
+
+#endif /* MN_MUX_H */
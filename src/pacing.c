@@ -0,0 +1,82 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pacing.h>
+
+#include <errno.h>
+
+static void mn_pacing_add(struct timespec *time, long int ns) {
+    time->tv_nsec += ns;
+    while(time->tv_nsec >= 1000000000l){
+        time->tv_nsec -= 1000000000l;
+        time->tv_sec++;
+    }
+}
+
+void mn_pacing_init(MNPacing *pacing, int pal) {
+    pacing->period = pal ? MN_PACING_PAL_PERIOD : MN_PACING_NTSC_PERIOD;
+
+    clock_gettime(CLOCK_MONOTONIC, &pacing->deadline);
+    mn_pacing_add(&pacing->deadline, pacing->period);
+}
+
+int mn_pacing_wait(MNPacing *pacing) {
+    struct timespec now;
+    struct timespec late;
+    int missed;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    missed = now.tv_sec > pacing->deadline.tv_sec ||
+             (now.tv_sec == pacing->deadline.tv_sec &&
+              now.tv_nsec > pacing->deadline.tv_nsec);
+
+    late = pacing->deadline;
+    mn_pacing_add(&late, pacing->period);
+
+    if(now.tv_sec > late.tv_sec || (now.tv_sec == late.tv_sec &&
+                                    now.tv_nsec > late.tv_nsec)){
+        /* We're too late, start again from now */
+        pacing->deadline = now;
+    }else{
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                              &pacing->deadline, NULL) == EINTR);
+    }
+
+    mn_pacing_add(&pacing->deadline, pacing->period);
+
+    return missed;
+}
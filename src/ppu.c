@@ -36,15 +36,120 @@
 
 #include <cpu.h>
 #include <dma.h>
+#include <ctrl.h>
+
+#include <mapper.h>
+#include <mux.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include <prof.h>
 
-int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
-                void draw_pixel(long int color)) {
+#include <counters.h>
+
+/* $3F10, $3F14, $3F18 and $3F1C mirror $3F00, $3F04, $3F08 and $3F0C */
+#define MN_PPU_PALETTE_IDX(addr) \
+    (((addr)&0x13) == 0x10 ? (addr)&0xF : (addr)&0x1F)
+
+static void mn_ppu_flush_line(MNPPU *ppu);
+
+/* The operations performed on each dot. See the frame timing diagram at
+ * https://www.nesdev.org/wiki/PPU_rendering */
+enum {
+    MN_PPU_DOT_BG_FETCH = 1,         /* Background fetch, step (dot-1)&7 */
+    MN_PPU_DOT_BG_SHIFT = 1<<1,      /* Shift the background registers */
+    MN_PPU_DOT_BG_DUMMY = 1<<2,      /* Unused nametable fetches */
+    MN_PPU_DOT_INC_Y = 1<<3,         /* Increment Y in v */
+    MN_PPU_DOT_COPY_X = 1<<4,        /* Copy the X bits of t to v */
+    MN_PPU_DOT_COPY_Y = 1<<5,        /* Copy the Y bits of t to v */
+    MN_PPU_DOT_PIXEL = 1<<6,         /* Output a pixel */
+    MN_PPU_DOT_LINE_START = 1<<7,    /* Record the emphasis bits of the line */
+    MN_PPU_DOT_OAM_CLEAR = 1<<8,     /* Clear secondary OAM */
+    MN_PPU_DOT_OAM_EVAL = 1<<9,      /* Sprite evaluation */
+    MN_PPU_DOT_OAM_FETCH = 1<<10,    /* Sprite fetch, step (dot-257)&7 */
+    MN_PPU_DOT_OAMADDR_CLEAR = 1<<11, /* Set OAMADDR to 0 */
+    MN_PPU_DOT_VBLANK = 1<<12,       /* Set the VBlank flag */
+    MN_PPU_DOT_CLEAR_FLAGS = 1<<13,  /* Clear the PPUSTATUS flags */
+    MN_PPU_DOT_SKIP = 1<<14          /* Skipped on odd frames when rendering */
+};
+
+/* The operations that involve the background or the sprite pipeline, that
+ * are only performed when rendering is enabled */
+#define MN_PPU_DOT_BG (MN_PPU_DOT_BG_FETCH|MN_PPU_DOT_BG_SHIFT| \
+                       MN_PPU_DOT_BG_DUMMY|MN_PPU_DOT_INC_Y|MN_PPU_DOT_PIXEL)
+#define MN_PPU_DOT_SPRITES (MN_PPU_DOT_OAM_CLEAR|MN_PPU_DOT_OAM_EVAL| \
+                            MN_PPU_DOT_OAM_FETCH|MN_PPU_DOT_PIXEL)
+
+enum {
+    MN_PPU_LINE_VISIBLE,
+    MN_PPU_LINE_POST_RENDER,
+    MN_PPU_LINE_VBLANK_START,
+    MN_PPU_LINE_VBLANK,
+    MN_PPU_LINE_PRE_RENDER,
+
+    MN_PPU_LINE_AMOUNT
+};
+
+static unsigned char mn_ppu_lines[262];
+static unsigned short int mn_ppu_dots[MN_PPU_LINE_AMOUNT][341];
+
+#define MN_PPU_DOT_ACTIONS() \
+    (mn_ppu_dots[mn_ppu_lines[ppu->scanline]][ppu->cycle])
+
+static void mn_ppu_init_dots(void) {
+    unsigned short int line;
+    unsigned short int dot;
+    unsigned short int actions;
+
+    for(line=0;line<262;line++){
+        if(line <= 239) mn_ppu_lines[line] = MN_PPU_LINE_VISIBLE;
+        else if(line == 240) mn_ppu_lines[line] = MN_PPU_LINE_POST_RENDER;
+        else if(line == 241) mn_ppu_lines[line] = MN_PPU_LINE_VBLANK_START;
+        else if(line <= 260) mn_ppu_lines[line] = MN_PPU_LINE_VBLANK;
+        else mn_ppu_lines[line] = MN_PPU_LINE_PRE_RENDER;
+    }
+
+    memset(mn_ppu_dots, 0, sizeof(mn_ppu_dots));
+
+    for(dot=0;dot<341;dot++){
+        /* Common to the visible and the pre-render lines */
+        actions = 0;
+        if((dot >= 1 && dot <= 256) || (dot >= 321 && dot <= 336)){
+            actions |= MN_PPU_DOT_BG_FETCH|MN_PPU_DOT_BG_SHIFT;
+        }
+        if(dot >= 337) actions |= MN_PPU_DOT_BG_DUMMY;
+        if(dot == 256) actions |= MN_PPU_DOT_INC_Y;
+        if(dot == 257) actions |= MN_PPU_DOT_COPY_X;
+        if(dot >= 257 && dot <= 320) actions |= MN_PPU_DOT_OAMADDR_CLEAR;
+
+        mn_ppu_dots[MN_PPU_LINE_PRE_RENDER][dot] = actions;
+
+        if(dot >= 1 && dot <= 256) actions |= MN_PPU_DOT_PIXEL;
+        if(dot == 1) actions |= MN_PPU_DOT_LINE_START;
+        if(dot >= 1 && dot <= 64) actions |= MN_PPU_DOT_OAM_CLEAR;
+        if(dot >= 65 && dot <= 256) actions |= MN_PPU_DOT_OAM_EVAL;
+        /* XXX: Dot 0 is idle on the hardware, but an evaluation step has
+         * always been performed on it, which can continue an overflow
+         * search that didn't end on the previous line. */
+        if(!dot) actions |= MN_PPU_DOT_OAM_EVAL;
+        if(dot >= 257 && dot <= 320) actions |= MN_PPU_DOT_OAM_FETCH;
+
+        mn_ppu_dots[MN_PPU_LINE_VISIBLE][dot] = actions;
+    }
+
+    for(dot=280;dot<=304;dot++){
+        mn_ppu_dots[MN_PPU_LINE_PRE_RENDER][dot] |= MN_PPU_DOT_COPY_Y;
+    }
+    mn_ppu_dots[MN_PPU_LINE_PRE_RENDER][1] |= MN_PPU_DOT_CLEAR_FLAGS;
+    mn_ppu_dots[MN_PPU_LINE_PRE_RENDER][340] |= MN_PPU_DOT_SKIP;
+
+    mn_ppu_dots[MN_PPU_LINE_VBLANK_START][1] |= MN_PPU_DOT_VBLANK;
+}
+
+int mn_ppu_init(MNPPU *ppu, MNFrame *frame) {
     /* TODO */
-    ppu->draw_pixel = draw_pixel;
+    ppu->frame = frame;
     ppu->cycles_since_cpu_cycle = 0;
 
     ppu->since_start = 0;
@@ -53,13 +158,95 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
     ppu->cycle = 0;
     ppu->scanline = 261;
 
-    ppu->palette = palette;
-
     ppu->keep_vblank_clear = 0;
 
+#if MN_CONFIG_PPU_FAST_VBLANK
+    ppu->accessed = 0;
+#endif
+
+#if MN_CONFIG_PPU_FAST_SPRITE_EVAL
+    ppu->lines_valid = 0;
+    ppu->fast_eval = 0;
+#endif
+
+    ppu->sprite_line_ok = 0;
+
+    ppu->mux_start = 0;
+    ppu->mux_end = 0;
+    mn_mux_init();
+
+    mn_ppu_init_dots();
+
+    ppu->mask = 0;
+    mn_mapper_ram_init(ppu->palette_ram, 32);
+
     return 0;
 }
 
+/* Decode a bitplane to the position of the low bitplane in a decoded row */
+static unsigned short int mn_ppu_decode_plane(unsigned char plane, int flip) {
+    unsigned char i;
+    unsigned short int row = 0;
+
+    for(i=0;i<8;i++){
+        row |= ((plane>>(7-i))&1)<<(flip ? i*2 : 14-i*2);
+    }
+
+    return row;
+}
+
+void mn_ppu_decode_row(MNTileRow *row, unsigned char low,
+                       unsigned char high) {
+    row->normal = mn_ppu_decode_plane(low, 0)|
+                  (mn_ppu_decode_plane(high, 0)<<1);
+    row->flipped = mn_ppu_decode_plane(low, 1)|
+                   (mn_ppu_decode_plane(high, 1)<<1);
+}
+
+static unsigned char mn_ppu_vram_read(MNPPU *ppu, MNEmu *emu,
+                                      unsigned short int addr) {
+    if(addr >= 0x3F00){
+        return ppu->palette_ram[MN_PPU_PALETTE_IDX(addr&0x1F)];
+    }
+
+    return emu->mapper.vram_read(emu, &emu->mapper, addr);
+}
+
+static void mn_ppu_vram_write(MNPPU *ppu, MNEmu *emu, unsigned short int addr,
+                              unsigned char value) {
+    if(addr >= 0x3F00){
+        /* The buffered pixels use the old colors */
+        mn_ppu_flush_line(ppu);
+        ppu->palette_ram[MN_PPU_PALETTE_IDX(addr&0x1F)] = value;
+        return;
+    }
+
+    emu->mapper.vram_write(emu, &emu->mapper, addr, value);
+}
+
+/* Rendering fetches go directly through the pages set by the mapper */
+#define MN_PPU_FETCH(addr) (ppu->pages[(addr)>>10][(addr)&0x3FF])
+/* The decoded row containing the bitplane at addr */
+#define MN_PPU_ROW(addr) \
+    (ppu->rows[(addr)>>10][(((addr)>>1)&0x1F8)|((addr)&7)])
+/* Masks to only keep the low or the high bitplane of a decoded row */
+#define MN_PPU_ROW_LOW  0x5555
+#define MN_PPU_ROW_HIGH 0xAAAA
+#define MN_PPU_ROW_FLIP(addr, flip) \
+    ((flip) ? MN_PPU_ROW(addr).flipped : MN_PPU_ROW(addr).normal)
+/* The bitplane fetched at addr taken from the decoded rows, moved to the
+ * position of the low or of the high bitplane. If rendering got enabled
+ * between two fetches, addr may point to the other bitplane or even outside
+ * of the pattern tables, where the fetched byte gets decoded. */
+#define MN_PPU_PLANE_LOW(addr, flip) \
+    ((addr) >= 0x2000 ? mn_ppu_decode_plane(ppu->video_mem_bus, flip) : \
+     (addr)&8 ? (MN_PPU_ROW_FLIP(addr, flip)>>1)&MN_PPU_ROW_LOW : \
+     MN_PPU_ROW_FLIP(addr, flip)&MN_PPU_ROW_LOW)
+#define MN_PPU_PLANE_HIGH(addr, flip) \
+    ((addr) >= 0x2000 ? mn_ppu_decode_plane(ppu->video_mem_bus, flip)<<1 : \
+     (addr)&8 ? MN_PPU_ROW_FLIP(addr, flip)&MN_PPU_ROW_HIGH : \
+     (MN_PPU_ROW_FLIP(addr, flip)<<1)&MN_PPU_ROW_HIGH)
+
 #define MN_PPU_BIT_RANGE(start, count) (((1<<(count))-1)<<(start))
 #define MN_PPU_BITS(count) ((1<<(count))-1)
 
@@ -129,13 +316,11 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
          * the shift registers, but the diagram on the same page of the wiki
          * and people on the NesDev Discord say that the shift registers shift
          * left, so we load the bits in the lower 8 bits. */ \
-        ppu->low_shift &= ~0xFF; \
-        ppu->high_shift &= ~0xFF; \
-        ppu->low_shift |= ppu->low_bp; \
-        ppu->high_shift |= ppu->high_bp; \
+        ppu->shift &= ~0xFFFF; \
+        ppu->shift |= ppu->row; \
  \
-        ppu->attr_latch1 = ppu->attr>>MN_PPU_BG_ATTR_START_BIT; \
-        ppu->attr_latch2 = ppu->attr>>MN_PPU_BG_ATTR_START_BIT>>1; \
+        ppu->attr_latch1 = (ppu->attr>>MN_PPU_BG_ATTR_START_BIT)&1; \
+        ppu->attr_latch2 = (ppu->attr>>MN_PPU_BG_ATTR_START_BIT>>1)&1; \
     })
 
 #define MN_PPU_BG_FETCHES_DONE() \
@@ -157,9 +342,7 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
                 ppu->video_mem_bus = ppu->addr; \
                 break; \
             case 1: \
-                ppu->tile_id = (ppu->video_mem_bus = emu->mapper. \
-                                vram_read(emu, &emu->mapper, \
-                                          ppu->addr)); \
+                ppu->tile_id = (ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr)); \
                 break; \
             case 2: \
                 /* Address calculated as described at
@@ -170,8 +353,7 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
                 ppu->video_mem_bus = ppu->addr; \
                 break; \
             case 3: \
-                ppu->attr = (ppu->video_mem_bus = emu->mapper. \
-                             vram_read(emu, &emu->mapper, ppu->addr)); \
+                ppu->attr = (ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr)); \
                 break; \
             case 4: \
                 ppu->addr = ((ppu->ctrl&1<<4)<<(12-4))|(ppu->tile_id<<4)| \
@@ -179,9 +361,9 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
                 ppu->video_mem_bus = ppu->addr; \
                 break; \
             case 5: \
-                ppu->low_bp = (ppu->video_mem_bus = emu->mapper. \
-                               vram_read(emu, &emu->mapper, \
-                                         ppu->addr)); \
+                ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr); \
+                ppu->row = (ppu->row&MN_PPU_ROW_HIGH)| \
+                           MN_PPU_PLANE_LOW(ppu->addr, 0); \
                 break; \
             case 6: \
                 ppu->addr = ((ppu->ctrl&1<<4)<<(12-4))|(ppu->tile_id<<4)| \
@@ -189,9 +371,9 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
                 ppu->video_mem_bus = ppu->addr; \
                 break; \
             case 7: \
-                ppu->high_bp = (ppu->video_mem_bus = emu->mapper. \
-                                vram_read(emu, &emu->mapper, \
-                                          ppu->addr)); \
+                ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr); \
+                ppu->row = (ppu->row&MN_PPU_ROW_LOW)| \
+                           MN_PPU_PLANE_HIGH(ppu->addr, 0); \
                 break; \
         } \
     })
@@ -199,10 +381,8 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
 #define MN_PPU_BG_SHIFT() \
     MN_PROF(mn_prof_ppu_bg_shift, { \
         /* Shift the shift registers */ \
-        ppu->low_shift <<= 1; \
-        ppu->low_shift |= 1; \
-        ppu->high_shift <<= 1; \
-        ppu->high_shift |= 1; \
+        ppu->shift <<= 2; \
+        ppu->shift |= 3; \
  \
         ppu->attr1_shift <<= 1; \
         ppu->attr1_shift |= ppu->attr_latch1; \
@@ -216,8 +396,7 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
         register unsigned char color; \
         register unsigned char palette; \
  \
-        color = ((ppu->low_shift>>(15-ppu->x))&1)|(((ppu->high_shift>> \
-                 (15-ppu->x))&1)<<1); \
+        color = (ppu->shift>>(30-ppu->x*2))&3; \
  \
         palette = ((ppu->attr1_shift>>(7-ppu->x))&1)| \
                   (((ppu->attr2_shift>>(7-ppu->x))&1)<<1); \
@@ -225,20 +404,31 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
         pixel = color|(palette<<2); \
     })
 
-#define MN_PPU_DRAW_PIXEL(pixel) \
+/* Store the palette RAM value of a pixel of the current line. The two upper
+ * bits are not stored, and grayscale only keeps the column of gray colors. */
+#define MN_PPU_DRAW_PIXEL(x, pixel) \
     MN_PROF(mn_prof_ppu_draw_pixel, { \
-        idx = emu->mapper.vram_read(emu, &emu->mapper, \
-                                    0x3F00+((pixel)>>2)*4+((pixel)&3)); \
-        /* The two upper bytes are not stored */ \
-        idx &= 0x3F; \
- \
-        if(ppu->mask&MN_PPU_MASK_GRAYSCALE) idx &= 0x30; \
- \
-        ppu->draw_pixel((ppu->palette[0x40*(ppu->mask>>5)+idx*3]<<16)| \
-                        (ppu->palette[0x40*(ppu->mask>>5)+idx*3+1]<<8)| \
-                        ppu->palette[0x40*(ppu->mask>>5)+idx*3+2]); \
+        ppu->frame->pixels[ppu->scanline][x] = ppu->palette_ram[pixel]& \
+            (ppu->mask&MN_PPU_MASK_GRAYSCALE ? 0x30 : 0x3F); \
     })
 
+/* Output the buffered pixels of the current line */
+static void mn_ppu_flush_line(MNPPU *ppu) {
+    unsigned char out[256];
+    unsigned short int i;
+
+    if(ppu->mux_start == ppu->mux_end) return;
+
+    mn_mux(out, ppu->mux_bg, ppu->mux_sprites, ppu->mask, ppu->mux_start,
+           ppu->mux_end);
+
+    for(i=ppu->mux_start;i<ppu->mux_end;i++){
+        MN_PPU_DRAW_PIXEL(i, out[i]);
+    }
+
+    ppu->mux_start = ppu->mux_end;
+}
+
 #define MN_PPU_INC_CYCLE() \
     { \
         ppu->cycle++; \
@@ -255,8 +445,10 @@ int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
 #define MN_PPU_BG_Y_BITS (MN_PPU_BG_FINE_Y|MN_PPU_BG_NAM_Y|MN_PPU_BG_COARSE_Y)
 #define MN_PPU_BG_X_BITS (MN_PPU_BG_NAM_X|MN_PPU_BG_COARSE_X)
 
-unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu);
-unsigned char mn_ppu_sprites(MNPPU *ppu, MNEmu *emu);
+static unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu,
+                               unsigned short int actions);
+static unsigned char mn_ppu_sprites(MNPPU *ppu, MNEmu *emu,
+                                    unsigned short int actions);
 
 /*
  * Border region:
@@ -267,114 +459,110 @@ unsigned char mn_ppu_sprites(MNPPU *ppu, MNEmu *emu);
  */
 void mn_ppu_cycle(MNPPU *ppu, MNEmu *emu) MN_PROF(mn_prof_ppu_cycle, {
     MNCPU *cpu = &emu->cpu;
-    unsigned char bg_pixel;
-    unsigned char sprite_pixel;
-    unsigned char idx;
+    unsigned char bg_pixel = 0;
+    unsigned char sprite_pixel = 0;
+    unsigned short int actions = MN_PPU_DOT_ACTIONS();
 
-    unsigned char pixel;
+    unsigned short int x;
 
-    if(ppu->scanline == 261 && ppu->cycle == 1){
+    if(actions&MN_PPU_DOT_CLEAR_FLAGS){
         /* XXX: Is this accurate? */
         cpu->nmi_pin = 1;
         /* Clear flags */
-        ppu->vblank = 0;
-        ppu->sprite0_hit = 0;
-        ppu->sprite_overflow = 0;
+        ppu->status = 0;
     }
 
-    if(ppu->scanline == 261 && ppu->cycle == 340 && !ppu->even_frame &&
+    if((actions&MN_PPU_DOT_SKIP) && !ppu->even_frame &&
        (ppu->mask&MN_PPU_MASK_RENDER)){
         /* Skip the last cycle of the pre-render scanline on an odd frames */
         MN_PPU_INC_CYCLE();
+        actions = MN_PPU_DOT_ACTIONS();
     }
 
-    if(ppu->scanline <= 239 || ppu->scanline == 261){
-        if(ppu->cycle >= 257 && ppu->cycle <= 320){
-            /* OAMADDR is repeatedly set to 0 during these cycles */
-            ppu->oamaddr = 0;
-        }
+    if(actions&MN_PPU_DOT_OAMADDR_CLEAR){
+        /* OAMADDR is repeatedly set to 0 during these cycles */
+        ppu->oamaddr = 0;
+    }
 
-        if(ppu->mask&MN_PPU_MASK_RENDER){
-            /* Visible scanlines or pre-render scanline */
+    if((actions&MN_PPU_DOT_LINE_START) && !emu->skip_video){
+        ppu->frame->lines[ppu->scanline] = MN_FRAME_EMPHASIS(ppu->mask);
+    }
+
+    if(ppu->mask&MN_PPU_MASK_RENDER){
+        /* Visible scanlines or pre-render scanline */
 
+        if(actions&MN_PPU_DOT_BG){
             MN_PROF(mn_prof_ppu_bg, {
-                bg_pixel = mn_ppu_bg(ppu, emu);
+                bg_pixel = mn_ppu_bg(ppu, emu, actions);
             });
+        }
 
-            if(ppu->cycle == 257){
-                /* Copy some bits of t to v */
-
-                ppu->v &= ~MN_PPU_BG_X_BITS;
-                ppu->v |= ppu->t&MN_PPU_BG_X_BITS;
-            }
-
-            if(ppu->scanline == 261){
-                /* Pre-render scanline only code */
-
-                if(ppu->cycle >= 280 && ppu->cycle <= 304){
-                    /* The PPU repeatedly copies these bits in these cycles of
-                     * the pre-render scanline. */
-                    ppu->v &= ~MN_PPU_BG_Y_BITS;
-                    ppu->v |= ppu->t&MN_PPU_BG_Y_BITS;
-                }
-            }else{
-                MN_PROF(mn_prof_ppu_oam, {
-                    sprite_pixel = mn_ppu_sprites(ppu, emu);
-                });
-
-                if(ppu->cycle >= 1 && ppu->cycle <= 256){
-
-                    if(!(ppu->mask&MN_PPU_MASK_BACKGROUND)) bg_pixel = 0;
-                    if(!(ppu->mask&MN_PPU_MASK_SPRITES)) sprite_pixel = 0;
+        if(actions&MN_PPU_DOT_COPY_X){
+            /* Copy some bits of t to v */
 
-                    if(!(ppu->mask&MN_PPU_MASK_BG_LEFTMOST_8PX) &&
-                       ppu->cycle <= 9){
-                        bg_pixel = 0;
-                    }
-                    if(!(ppu->mask&MN_PPU_MASK_SPRITES_LEFTMOST_8PX) &&
-                       ppu->cycle <= 9){
-                        sprite_pixel = 0;
-                    }
-
-                    pixel = (sprite_pixel&3)|((((sprite_pixel>>2)&3)+4)<<2);
+            ppu->v &= ~MN_PPU_BG_X_BITS;
+            ppu->v |= ppu->t&MN_PPU_BG_X_BITS;
+        }
 
-                    /* Select the right pixel and output it */
-                    if((bg_pixel&3) && (sprite_pixel&3) &&
-                       ((sprite_pixel)&(1<<5)) && ppu->cycle != 256){
-                        ppu->sprite0_hit = 1;
-                    }
-                    if(((sprite_pixel&(1<<4)) && (bg_pixel&3)) ||
-                       !(sprite_pixel&3)){
-                        pixel = bg_pixel;
-                    }
+        if(actions&MN_PPU_DOT_COPY_Y){
+            /* The PPU repeatedly copies these bits in these cycles of the
+             * pre-render scanline. */
+            ppu->v &= ~MN_PPU_BG_Y_BITS;
+            ppu->v |= ppu->t&MN_PPU_BG_Y_BITS;
+        }
 
-                    if(!(pixel&3)) pixel = 0;
+        if(actions&MN_PPU_DOT_SPRITES){
+            MN_PROF(mn_prof_ppu_oam, {
+                sprite_pixel = mn_ppu_sprites(ppu, emu, actions);
+            });
+        }
 
-                    MN_PPU_DRAW_PIXEL(pixel);
-                }
+        if(actions&MN_PPU_DOT_PIXEL){
+            x = ppu->cycle-1;
+
+            if((sprite_pixel&(1<<5)) && (sprite_pixel&3) &&
+               (bg_pixel&3) && ppu->cycle != 256 &&
+               (ppu->mask&MN_PPU_MASK_BACKGROUND) &&
+               (ppu->mask&MN_PPU_MASK_SPRITES) &&
+               (ppu->cycle > 9 ||
+                ((ppu->mask&MN_PPU_MASK_BG_LEFTMOST_8PX) &&
+                 (ppu->mask&MN_PPU_MASK_SPRITES_LEFTMOST_8PX)))){
+                ppu->status |= MN_PPU_STATUS_SPRITE0_HIT;
             }
-        }else{
-            if(ppu->cycle >= 1 && ppu->cycle <= 256){
-                if(ppu->scanline != 261){
-                    /* Produce a pixel */
 
-                    /* TODO */
-                    MN_PPU_DRAW_PIXEL(0);
+            /* Buffer the pixels, they are combined when the line is output.
+             * This does not affect the state of the emulator, so it can be
+             * skipped when the frame is not displayed. */
+            if(!emu->skip_video){
+                if(ppu->mux_end != x){
+                    mn_ppu_flush_line(ppu);
+                    ppu->mux_start = x;
+                    ppu->mux_end = x;
                 }
+
+                ppu->mux_bg[x] = bg_pixel;
+                ppu->mux_sprites[x] = sprite_pixel;
+                ppu->mux_end++;
+
+                if(ppu->cycle == 256) mn_ppu_flush_line(ppu);
             }
         }
-    }else if(ppu->scanline == 240){
-        /* Post-render scanline */
-    }else if(ppu->scanline <= 260){
-        if(ppu->scanline == 241 && ppu->cycle == 1){
-            /* Set the VBlank flag and trigger NMI */
-            if(!ppu->keep_vblank_clear) ppu->vblank = 1;
-            ppu->keep_vblank_clear = 0;
-        }
-        /* Vertical blanking lines */
+    }else if((actions&MN_PPU_DOT_PIXEL) && !emu->skip_video){
+        /* Produce a pixel */
+
+        /* TODO */
+        MN_PPU_DRAW_PIXEL(ppu->cycle-1, 0);
     }
 
-    if(ppu->ctrl&MN_PPU_CTRL_NMI && ppu->vblank){
+    if(actions&MN_PPU_DOT_VBLANK){
+        /* Set the VBlank flag and trigger NMI */
+        if(!ppu->keep_vblank_clear) ppu->status |= MN_PPU_STATUS_VBLANK;
+        ppu->keep_vblank_clear = 0;
+    }
+
+    if(ppu->ctrl&MN_PPU_CTRL_NMI && ppu->status&MN_PPU_STATUS_VBLANK){
+        /* Only count the falling edges */
+        MN_COUNT_ADD(emu, nmis, cpu->nmi_pin);
         cpu->nmi_pin = 0;
     }
 
@@ -396,16 +584,92 @@ void mn_ppu_cycle(MNPPU *ppu, MNEmu *emu) MN_PROF(mn_prof_ppu_cycle, {
     ppu->cycles_since_cpu_cycle++;
 })
 
-unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu) {
+#if MN_CONFIG_PPU_FAST_VBLANK
+/* Moves forward by less than a scanline, without leaving the frame */
+static void mn_ppu_advance(MNPPU *ppu, unsigned int dots) {
+    ppu->cycle += dots;
+    if(ppu->cycle > 340){
+        ppu->cycle -= 341;
+        ppu->scanline++;
+    }
+
+    ppu->since_start += dots;
+    if(ppu->since_start > ppu->startup_time){
+        ppu->since_start = ppu->startup_time;
+    }
+}
+
+/* Runs the dots of lines 240 to 260 where the PPU has nothing to do, up to the
+ * dot setting the VBlank flag or to the pre-render line. Only the CPU, the DMA
+ * and the controllers have to run there, once every 3 dots. The NMI line only
+ * changes on register accesses, so it is checked once and the loop stops after
+ * the first CPU cycle touching the PPU. Returns the number of dots run, 0 when
+ * the current dot has to be stepped. */
+unsigned int mn_ppu_vblank(MNPPU *ppu, MNEmu *emu) {
+    MNCPU *cpu = &emu->cpu;
+    unsigned int dots;
+    unsigned int done;
+    unsigned int n;
+
+    if(ppu->scanline < 240 || ppu->scanline > 260) return 0;
+
+    if(ppu->scanline == 240 || (ppu->scanline == 241 && !ppu->cycle)){
+        dots = (241-ppu->scanline)*341+1-ppu->cycle;
+    }else if(ppu->scanline == 241 && ppu->cycle == 1){
+        return 0;
+    }else{
+        dots = (261-ppu->scanline)*341-ppu->cycle;
+    }
+
+    if(ppu->ctrl&MN_PPU_CTRL_NMI && ppu->status&MN_PPU_STATUS_VBLANK){
+        /* Only count the falling edges */
+        MN_COUNT_ADD(emu, nmis, cpu->nmi_pin);
+        cpu->nmi_pin = 0;
+    }
+
+    ppu->accessed = 0;
+    done = 0;
+
+    /* Dots up to and including the next one running the CPU */
+    n = 4-ppu->cycles_since_cpu_cycle;
+    while(n <= dots){
+        mn_ppu_advance(ppu, n);
+
+        MN_PROF(mn_prof_cpu_cycle, {
+            mn_cpu_cycle(cpu, emu);
+        });
+        mn_dma_cycle(&emu->dma, emu);
+        ppu->cycles_since_cpu_cycle = 1;
+
+        /* The controllers reload the same input on the other 2 dots */
+        mn_ctrl_cycle(&emu->ctrl1, emu);
+        mn_ctrl_cycle(&emu->ctrl2, emu);
+
+        dots -= n;
+        done += n;
+        n = 3;
+
+        if(ppu->accessed) return done;
+    }
+
+    mn_ppu_advance(ppu, dots);
+    ppu->cycles_since_cpu_cycle += dots;
+
+    return done+dots;
+}
+#endif
+
+static unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu,
+                               unsigned short int actions) {
     unsigned char pixel = 0;
 
+    /* The fetches go through ppu->pages */
+    (void)emu;
+
     /* Memory fetches */
-    if(ppu->cycle >= 321 && ppu->cycle <= 336){
-        MN_PPU_BG_FETCH(ppu->cycle-321);
-        MN_PPU_BG_SHIFT();
-    }else if(ppu->cycle >= 1 && ppu->cycle <= 256){
+    if(actions&MN_PPU_DOT_BG_FETCH){
         MN_PPU_BG_FETCH(ppu->cycle-1);
-    }else if(ppu->cycle >= 337 && ppu->cycle <= 340){
+    }else if(actions&MN_PPU_DOT_BG_DUMMY){
         /* Dummy nametable fetches */
         switch((ppu->cycle-337)&3){
             case 0:
@@ -413,51 +677,27 @@ unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu) {
                 ppu->video_mem_bus = ppu->addr;
                 break;
             case 1:
-                ppu->tile_id = (ppu->video_mem_bus = emu->mapper.
-                                vram_read(emu, &emu->mapper,
-                                          ppu->addr));
+                ppu->tile_id = (ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr));
                 break;
         }
     }
 
-    if(ppu->cycle == 0){
-        /* Cycle 0 is an IDLE cycle */
-    }else if(ppu->cycle >= 1 && ppu->cycle <= 256){
-        if(ppu->scanline != 261){
-            /* Produce a background pixel */
-            MN_PPU_BG_GET_PIXEL();
-        }
+    if(actions&MN_PPU_DOT_PIXEL){
+        /* Produce a background pixel */
+        MN_PPU_BG_GET_PIXEL();
+    }
 
-        /* NOTE: The NesDev wiki says shift registers should shift for the
-         * first time at cycle 2, but it was causing a small graphical
-         * glitch. I don't know if I should perform the shifts before the
-         * fetches then... */
-#if 0
-        if(ppu->cycle >= 2){
-            /* Shift registers shift for the first time at cycle 2 */
-#endif
-            MN_PPU_BG_SHIFT();
-#if 0
-        }
-#endif
+    /* NOTE: The NesDev wiki says shift registers should shift for the first
+     * time at cycle 2, but it was causing a small graphical glitch. I don't
+     * know if I should perform the shifts before the fetches then... */
+    if(actions&MN_PPU_DOT_BG_SHIFT){
+        MN_PPU_BG_SHIFT();
+    }
 
-        if(ppu->cycle == 256){
-            /* Increment Y */
+    if(actions&MN_PPU_DOT_INC_Y){
+        /* Increment Y */
 
-            MN_PPU_BG_Y_INC();
-        }
-    }else if(ppu->cycle >= 337){
-        switch((ppu->cycle-321)&3){
-            case 0:
-                ppu->addr = 0x2000|(ppu->v&0x0FFF);
-                ppu->video_mem_bus = ppu->addr;
-                break;
-            case 1:
-                ppu->tile_id = (ppu->video_mem_bus = emu->mapper.
-                                vram_read(emu, &emu->mapper,
-                                          ppu->addr));
-                break;
-        }
+        MN_PPU_BG_Y_INC();
     }
 
     return pixel;
@@ -480,6 +720,19 @@ unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu) {
 
 #define MN_PPU_OAM_BIG_SPRITES (ppu->ctrl&MN_PPU_CTRL_BIG_SPRITES)
 
+#if MN_CONFIG_PPU_FAST_SPRITE_EVAL
+/* Writes that affect the sprite evaluation of the current line need it to be
+ * done dot by dot up to now. */
+#define MN_PPU_SYNC_EVAL() \
+    { \
+        if(ppu->fast_eval) mn_ppu_replay_eval(ppu, emu); \
+    }
+#define MN_PPU_INVALIDATE_LINES() (ppu->lines_valid = 0)
+#else
+#define MN_PPU_SYNC_EVAL()
+#define MN_PPU_INVALIDATE_LINES()
+#endif
+
 #define MN_PPU_OAM_FETCH(step) \
     { \
         register unsigned char v_flip, h_flip; \
@@ -492,9 +745,7 @@ unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu) {
                 ppu->video_mem_bus = ppu->addr; \
                 break; \
             case 1: \
-                ppu->tile_id = (ppu->video_mem_bus = emu->mapper. \
-                                vram_read(emu, &emu->mapper, \
-                                          ppu->addr)); \
+                ppu->tile_id = (ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr)); \
                 break; \
             case 2: \
                 /* Address calculated as described at
@@ -505,8 +756,7 @@ unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu) {
                 ppu->video_mem_bus = ppu->addr; \
                 break; \
             case 3: \
-                ppu->attr = (ppu->video_mem_bus = emu->mapper. \
-                             vram_read(emu, &emu->mapper, ppu->addr)); \
+                ppu->attr = (ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr)); \
                 break; \
             case 4: \
                 /* XXX: On which dots do the attributes from secondary OAM fill
@@ -536,17 +786,13 @@ unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu) {
                 break; \
             case 5: \
                 h_flip = (ppu->secondary_oam[pos+2]>>6)&1; \
-                attr = (ppu->video_mem_bus = emu->mapper. \
-                               vram_read(emu, &emu->mapper, \
-                                         ppu->addr)); \
-                if(h_flip){ \
-                    attr = (attr>>7)|((attr>>6)&1)<<1|((attr>>5)&1)<<2| \
-                           ((attr>>4)&1)<<3|((attr>>3)&1)<<4| \
-                           ((attr>>2)&1)<<5|((attr>>1)&1)<<6|(attr&1)<<7; \
-                } \
+                ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr); \
+                ppu->sprite_fifo[(step)>>3].row &= MN_PPU_ROW_HIGH; \
                 /* XXX: Is this accurate? */ \
-                if(ppu->secondary_oam_pos <= pos) attr = 0; \
-                ppu->sprite_fifo[(step)>>3].low_bp = attr; \
+                if(ppu->secondary_oam_pos > pos){ \
+                    ppu->sprite_fifo[(step)>>3].row |= \
+                        MN_PPU_PLANE_LOW(ppu->addr, h_flip); \
+                } \
                 break; \
             case 6: \
                 y = ppu->secondary_oam[pos]; \
@@ -571,26 +817,262 @@ unsigned char mn_ppu_bg(MNPPU *ppu, MNEmu *emu) {
                 break; \
             case 7: \
                 h_flip = (ppu->secondary_oam[pos+2]>>6)&1; \
-                attr = (ppu->video_mem_bus = emu->mapper. \
-                                vram_read(emu, &emu->mapper, \
-                                          ppu->addr)); \
-                if(h_flip){ \
-                    attr = (attr>>7)|((attr>>6)&1)<<1|((attr>>5)&1)<<2| \
-                           ((attr>>4)&1)<<3|((attr>>3)&1)<<4| \
-                           ((attr>>2)&1)<<5|((attr>>1)&1)<<6|(attr&1)<<7; \
-                } \
+                ppu->video_mem_bus = MN_PPU_FETCH(ppu->addr); \
+                ppu->sprite_fifo[(step)>>3].row &= MN_PPU_ROW_LOW; \
                 /* XXX: Is this accurate? */ \
-                if(ppu->secondary_oam_pos <= pos) attr = 0; \
-                ppu->sprite_fifo[(step)>>3].high_bp = attr; \
+                if(ppu->secondary_oam_pos > pos){ \
+                    ppu->sprite_fifo[(step)>>3].row |= \
+                        MN_PPU_PLANE_HIGH(ppu->addr, h_flip); \
+                } \
+                mn_ppu_paint_sprite(ppu, (step)>>3); \
                 break; \
         } \
     }
 
-unsigned char mn_ppu_sprites(MNPPU *ppu, MNEmu *emu) {
+/* Perform one dot of sprite evaluation, on dots 65-256 */
+static void mn_ppu_eval_dot(MNPPU *ppu, MNEmu *emu) {
     register unsigned char read = 0;
+    unsigned char inc = 0;
+
+    /* Only used by the counters */
+    (void)emu;
+
+    if(ppu->cycle&1){
+        /* Data is read from primary OAM */
+        ppu->b = ppu->primary_oam[ppu->oamaddr];
+    }else{
+        /* Data is written to secondary OAM */
+
+        /* Step 1 */
+        if(ppu->step == 0){
+            ppu->y = ppu->b;
+            if(MN_PPU_OAM_IN_RANGE(ppu->y)){
+                inc = 1;
+                MN_COUNT(emu, sprites_found);
+
+                if(!ppu->oamaddr) ppu->sprite0_loaded = 1;
+
+                ppu->step++;
+                ppu->oamaddr++;
+#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
+                printf("%03u %03u %u %02x: Sprite in range\n",
+                       ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
+#endif
+            }else{
+                ppu->step = 2;
+                ppu->oamaddr += 4;
+#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
+                printf("%03u %03u %u %02x: Skipping sprite\n",
+                       ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
+#endif
+            }
+        }else if(ppu->step == 1){
+            /* Copy the rest of sprite to secondary OAM */
+            ppu->oamaddr++;
+            inc = 1;
+            if(!(ppu->oamaddr&3)) ppu->step++;
+#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
+            printf("%03u %03u %u %02x: Sprite copy\n", ppu->scanline,
+                   ppu->y, ppu->step, ppu->oamaddr);
+#endif
+        }
+
+        /* Step 2 */
+        if(ppu->step == 2){
+            if(!ppu->oamaddr){
+                /* n has overflowed back to 0, all sprites got
+                 * evaluated */
+                ppu->step = 4;
+#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
+                printf("%03u %03u %u %02x: All sprites got evaluated\n",
+                       ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
+#endif
+            }else{
+                if(ppu->secondary_oam_pos >= 32){
+                    /* 8 sprites have been found */
+                    ppu->entries_read = 0;
+                    ppu->step++;
+#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
+                    printf("%03u %03u %u %02x: 8 sprites found!\n",
+                           ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
+#endif
+                }else{
+                    /* Continue copying sprites */
+                    ppu->step = 0;
+                }
+#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
+                printf("%03u %03u %u %02x: Continue\n", ppu->scanline,
+                       ppu->y, ppu->step, ppu->oamaddr);
+#endif
+            }
+        }
+
+        /* Step 3 */
+        if(ppu->step == 3){
+            if(MN_PPU_OAM_IN_RANGE(ppu->b)){
+                ppu->status |= MN_PPU_STATUS_OVERFLOW;
+                ppu->entries_read = 0;
+                read = 1;
+            }else{
+                ppu->oamaddr += 5;
+                if(!(ppu->oamaddr&~3)){
+                    ppu->oamaddr &= ~3;
+                    ppu->step++;
+                }
+            }
+            if(ppu->entries_read || read){
+                ppu->oamaddr++;
+                ppu->entries_read++;
+            }
+        }
+
+        /* Step 4 */
+        if(ppu->step == 4){
+            /* Fail to write OAM[n][0] */
+        }
+
+        MN_PPU_OAM_WRITE(ppu->b);
+        if(inc && ppu->secondary_oam_pos < 32){
+            ppu->secondary_oam_pos++;
+        }
+    }
+}
+
+#if MN_CONFIG_PPU_FAST_SPRITE_EVAL
+
+/* Find the sprites in range of each visible scanline */
+static void mn_ppu_bin_sprites(MNPPU *ppu) {
+    unsigned char i;
+    unsigned short int line, end;
+
+    memset(ppu->line_sprite_num, 0, 240);
+
+    for(i=0;i<64;i++){
+        line = ppu->primary_oam[i*4];
+        end = line+(MN_PPU_OAM_BIG_SPRITES ? 16 : 8);
+        if(end > 240) end = 240;
+        for(;line<end;line++){
+            if(ppu->line_sprite_num[line] < 8){
+                ppu->line_sprites[line][ppu->line_sprite_num[line]++] = i;
+            }
+        }
+    }
+
+    ppu->lines_valid = 1;
+}
+
+/* Called on dot 65. If the evaluation starts at the first sprite and finds
+ * less than 8 sprites, it doesn't run into the overflow search, and its
+ * result can be calculated at once from the sprites in range. Lines with 8
+ * or more sprites are evaluated dot by dot. */
+static void mn_ppu_fast_eval(MNPPU *ppu) {
+    unsigned char i;
+    unsigned char num;
+
+    if(ppu->oamaddr) return;
+
+    if(!ppu->lines_valid) mn_ppu_bin_sprites(ppu);
+
+    num = ppu->line_sprite_num[ppu->scanline];
+    if(num >= 8) return;
+
+    /* Keep what is needed to replay the evaluation */
+    memcpy(ppu->eval_secondary_oam, ppu->secondary_oam, 32);
+    ppu->eval_y = ppu->y;
+
+    for(i=0;i<num;i++){
+        memcpy(ppu->secondary_oam+i*4,
+               ppu->primary_oam+ppu->line_sprites[ppu->scanline][i]*4, 4);
+    }
+    ppu->secondary_oam_pos = num*4;
+    ppu->sprite0_loaded = num && !ppu->line_sprites[ppu->scanline][0];
+
+    /* All 64 sprites get evaluated before dot 256. OAMADDR then stays at 0,
+     * and the Y position of sprite 0 gets copied to the next free entry until
+     * the end of the evaluation. */
+    ppu->step = 4;
+    ppu->y = ppu->primary_oam[63*4];
+    ppu->b = ppu->primary_oam[0];
+    ppu->secondary_oam[ppu->secondary_oam_pos] = ppu->b;
+
+    ppu->fast_eval = 1;
+}
+
+/* Run the evaluation of the current line dot by dot up to the current dot,
+ * before something it depends on gets modified. */
+static void mn_ppu_replay_eval(MNPPU *ppu, MNEmu *emu) {
+    unsigned short int cycle = ppu->cycle;
+
+    ppu->fast_eval = 0;
+
+    /* Restore the state after dot 65 */
+    memcpy(ppu->secondary_oam, ppu->eval_secondary_oam, 32);
+    ppu->secondary_oam_pos = 0;
+    ppu->step = 0;
+    ppu->sprite0_loaded = 0;
+    ppu->oamaddr = 0;
+    ppu->y = ppu->eval_y;
+    ppu->b = ppu->primary_oam[0];
+
+    for(ppu->cycle=66;ppu->cycle<cycle;ppu->cycle++){
+        mn_ppu_eval_dot(ppu, emu);
+    }
+    ppu->cycle = cycle;
+}
+
+#endif
+
+/* Paint a sprite that just got fetched into the line buffer, behind the
+ * sprites of the slots before it. */
+static void mn_ppu_paint_sprite(MNPPU *ppu, unsigned char slot) {
+    unsigned char i;
+    unsigned short int x = ppu->sprite_fifo[slot].down_counter;
+    unsigned short int row = ppu->sprite_fifo[slot].row;
+    unsigned char attr;
+
+    attr = ppu->sprite_fifo[slot].palette<<2|
+           ppu->sprite_fifo[slot].priority<<4|
+           (!slot)<<5;
+
+    for(i=0;i<8 && x<256;i++,x++){
+        if((row>>14) && !(ppu->sprite_line[x]&3)){
+            ppu->sprite_line[x] = (row>>14)|attr;
+        }
+        row <<= 2;
+    }
+}
+
+/* Bring the sprite FIFO to the state it would have after n dots of the line
+ * rendered from the line buffer. */
+static void mn_ppu_advance_sprites(MNPPU *ppu, unsigned short int n) {
+    unsigned char i;
+    short int shifts;
+
+    for(i=0;i<8;i++){
+        shifts = n-ppu->sprite_fifo[i].down_counter;
+        if(shifts > 8) shifts = 8;
+        if(shifts > 0){
+            ppu->sprite_fifo[i].row = (ppu->sprite_fifo[i].row<<(shifts*2))&
+                                      0xFFFF;
+        }
+        ppu->sprite_fifo[i].down_counter -= n;
+    }
+}
+
+/* Stop using the line buffer, when rendering gets toggled. */
+static void mn_ppu_sync_sprites(MNPPU *ppu) {
+    if(!ppu->sprite_line_ok) return;
+
+    if(ppu->scanline < 240 && ppu->cycle >= 1 && ppu->cycle <= 257){
+        mn_ppu_advance_sprites(ppu, ppu->cycle-1);
+    }
+    ppu->sprite_line_ok = 0;
+}
+
+static unsigned char mn_ppu_sprites(MNPPU *ppu, MNEmu *emu,
+                                    unsigned short int actions) {
     unsigned char sprite_pixel = 0;
     unsigned char i;
-    unsigned char inc = 0;
 
 #if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
     if(ppu->cycle == 257){
@@ -605,138 +1087,69 @@ unsigned char mn_ppu_sprites(MNPPU *ppu, MNEmu *emu) {
     }
 #endif
 
-    if(ppu->cycle >= 1 && ppu->cycle <= 64){
+    if(actions&MN_PPU_DOT_OAM_CLEAR){
         ppu->secondary_oam[(ppu->cycle-1)>>1] = 0xFF;
-    }else if(ppu->cycle <= 256){
+    }else if(actions&MN_PPU_DOT_OAM_EVAL){
         if(ppu->cycle == 65){
             ppu->secondary_oam_pos = 0;
             ppu->step = 0;
             /* XXX: Is this way of handling sprite zero hit accurate enough? */
             ppu->was_sprite0_loaded = ppu->sprite0_loaded;
             ppu->sprite0_loaded = 0;
+            MN_COUNT(emu, sprite_evals);
 #if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
             puts("SPRITE EVALUATION");
 #endif
         }
-        if(ppu->cycle&1){
-            /* Data is read from primary OAM */
-            ppu->b = ppu->primary_oam[ppu->oamaddr];
-        }else{
-            /* Data is written to secondary OAM */
-
-            /* Step 1 */
-            if(ppu->step == 0){
-                ppu->y = ppu->b;
-                if(MN_PPU_OAM_IN_RANGE(ppu->y)){
-                    inc = 1;
-
-                    if(!ppu->oamaddr) ppu->sprite0_loaded = 1;
-
-                    ppu->step++;
-                    ppu->oamaddr++;
-#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
-                    printf("%03u %03u %u %02x: Sprite in range\n",
-                           ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
-#endif
-                }else{
-                    ppu->step = 2;
-                    ppu->oamaddr += 4;
-#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
-                    printf("%03u %03u %u %02x: Skipping sprite\n",
-                           ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
-#endif
-                }
-            }else if(ppu->step == 1){
-                /* Copy the rest of sprite to secondary OAM */
-                ppu->oamaddr++;
-                inc = 1;
-                if(!(ppu->oamaddr&3)) ppu->step++;
-#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
-                printf("%03u %03u %u %02x: Sprite copy\n", ppu->scanline,
-                       ppu->y, ppu->step, ppu->oamaddr);
-#endif
-            }
-
-            /* Step 2 */
-            if(ppu->step == 2){
-                if(!ppu->oamaddr){
-                    /* n has overflowed back to 0, all sprites got
-                     * evaluated */
-                    ppu->step = 4;
-#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
-                    printf("%03u %03u %u %02x: All sprites got evaluated\n",
-                           ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
-#endif
-                }else{
-                    if(ppu->secondary_oam_pos >= 32){
-                        /* 8 sprites have been found */
-                        ppu->entries_read = 0;
-                        ppu->step++;
-#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
-                        printf("%03u %03u %u %02x: 8 sprites found!\n",
-                               ppu->scanline, ppu->y, ppu->step, ppu->oamaddr);
+#if MN_CONFIG_PPU_FAST_SPRITE_EVAL
+        if(!ppu->fast_eval) mn_ppu_eval_dot(ppu, emu);
+        if(ppu->cycle == 65) mn_ppu_fast_eval(ppu);
+#else
+        mn_ppu_eval_dot(ppu, emu);
 #endif
-                    }else{
-                        /* Continue copying sprites */
-                        ppu->step = 0;
-                    }
-#if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
-                    printf("%03u %03u %u %02x: Continue\n", ppu->scanline,
-                           ppu->y, ppu->step, ppu->oamaddr);
+    }else if(actions&MN_PPU_DOT_OAM_FETCH){
+#if MN_CONFIG_PPU_FAST_SPRITE_EVAL
+        if(ppu->fast_eval){
+            /* The evaluation is done, it can't be affected anymore */
+            ppu->fast_eval = 0;
+            MN_COUNT_ADD(emu, sprites_found, ppu->secondary_oam_pos>>2);
+        }
 #endif
-                }
-            }
-
-            /* Step 3 */
-            if(ppu->step == 3){
-                if(MN_PPU_OAM_IN_RANGE(ppu->b)){
-                    ppu->sprite_overflow = 1;
-                    ppu->entries_read = 0;
-                    read = 1;
-                }else{
-                    ppu->oamaddr += 5;
-                    if(!(ppu->oamaddr&~3)){
-                        ppu->oamaddr &= ~3;
-                        ppu->step++;
-                    }
-                }
-                if(ppu->entries_read || read){
-                    ppu->oamaddr++;
-                    ppu->entries_read++;
-                }
-            }
-
-            /* Step 4 */
-            if(ppu->step == 4){
-                /* Fail to write OAM[n][0] */
-            }
-
-            MN_PPU_OAM_WRITE(ppu->b);
-            if(inc && ppu->secondary_oam_pos < 32){
-                ppu->secondary_oam_pos++;
-            }
+        if(ppu->cycle == 257){
+            /* The FIFO was not updated while the line buffer was used */
+            if(ppu->sprite_line_ok) mn_ppu_advance_sprites(ppu, 256);
+
+            /* The sprites are painted into the line buffer as they get
+             * fetched. It can only be used if rendering stays enabled
+             * until the next line is rendered. */
+            memset(ppu->sprite_line, 0, 256);
+            ppu->sprite_line_ok = 1;
         }
-    }else if(ppu->cycle <= 320){
+
         /* Sprite fetches */
         MN_PPU_OAM_FETCH(ppu->cycle-257);
-    }else if(ppu->cycle <= 340 || !ppu->cycle){
-        /* Background pipeline initialization */
     }
 
 #if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
-    if(ppu->cycle == 340){
+    if(ppu->cycle == 320){
         int i;
         printf("[scanline %u] Sprite FIFO dump:\n", ppu->scanline);
         for(i=0;i<8;i++){
-            printf("l: %02x h: %02x x: %02x p: %u bg? %u\n",
-                   ppu->sprite_fifo[i].low_bp, ppu->sprite_fifo[i].high_bp,
+            printf("row: %04x x: %02x p: %u bg? %u\n",
+                   ppu->sprite_fifo[i].row,
                    ppu->sprite_fifo[i].down_counter,
                    ppu->sprite_fifo[i].palette, ppu->sprite_fifo[i].priority);
         }
     }
 #endif
 
-    if(ppu->cycle >= 1 && ppu->cycle <= 256){
+    if(!(actions&MN_PPU_DOT_PIXEL)){
+        /* No pixel is produced on this dot */
+    }else if(ppu->sprite_line_ok){
+        /* Get the pixel from the line buffer */
+        sprite_pixel = ppu->sprite_line[ppu->cycle-1];
+        if(!ppu->was_sprite0_loaded) sprite_pixel &= ~(1<<5);
+    }else{
         /* Produce a pixel */
 
 #if MN_CONFIG_PPU_DEBUG_SPRITE_EVAL
@@ -746,23 +1159,24 @@ unsigned char mn_ppu_sprites(MNPPU *ppu, MNEmu *emu) {
         for(i=8;i--;){
             if(ppu->sprite_fifo[i].down_counter <= 0 &&
                ppu->sprite_fifo[i].down_counter > -8){
-                /* Get a sprite pixel */
-                register unsigned char pixel;
+                /* Get a sprite pixel. If the frame is not displayed, only
+                 * the first slot matters, for sprite 0 hits. */
+                if(!i || !emu->skip_video){
+                    register unsigned char pixel;
 
-                pixel = (ppu->sprite_fifo[i].low_bp>>7)|
-                        (ppu->sprite_fifo[i].high_bp>>7)<<1|
-                        ppu->sprite_fifo[i].palette<<2|
-                        ppu->sprite_fifo[i].priority<<4;
+                    pixel = (ppu->sprite_fifo[i].row>>14)|
+                            ppu->sprite_fifo[i].palette<<2|
+                            ppu->sprite_fifo[i].priority<<4;
 
-                if(!i && ppu->was_sprite0_loaded){
-                    pixel |= 1<<5;
-                }
+                    if(!i && ppu->was_sprite0_loaded){
+                        pixel |= 1<<5;
+                    }
 
-                if(pixel&3) sprite_pixel = pixel;
+                    if(pixel&3) sprite_pixel = pixel;
+                }
 
                 /* Shift the shift registers */
-                ppu->sprite_fifo[i].low_bp <<= 1;
-                ppu->sprite_fifo[i].high_bp <<= 1;
+                ppu->sprite_fifo[i].row <<= 2;
             }
             ppu->sprite_fifo[i].down_counter--;
         }
@@ -775,6 +1189,12 @@ unsigned char mn_ppu_read(MNPPU *ppu, MNEmu *emu, unsigned short int reg) {
     unsigned char v;
     unsigned short int addr;
 
+    MN_COUNT(emu, ppu_reads[reg]);
+
+#if MN_CONFIG_PPU_FAST_VBLANK
+    ppu->accessed = 1;
+#endif
+
     switch(reg){
         case MN_PPU_CTRL:
             break;
@@ -782,9 +1202,8 @@ unsigned char mn_ppu_read(MNPPU *ppu, MNEmu *emu, unsigned short int reg) {
             break;
         case MN_PPU_STATUS:
             ppu->io_bus &= (1<<5)-1;
-            ppu->io_bus |= (ppu->vblank<<7)|(ppu->sprite0_hit<<6)|
-                           (ppu->sprite_overflow<<5);
-            ppu->vblank = 0;
+            ppu->io_bus |= ppu->status;
+            ppu->status &= ~MN_PPU_STATUS_VBLANK;
             if(ppu->scanline == 241 && ppu->cycle == 0){
                 ppu->keep_vblank_clear = 1;
             }
@@ -793,6 +1212,7 @@ unsigned char mn_ppu_read(MNPPU *ppu, MNEmu *emu, unsigned short int reg) {
         case MN_PPU_OAMADDR:
             break;
         case MN_PPU_OAMDATA:
+            MN_PPU_SYNC_EVAL();
             ppu->io_bus = ppu->primary_oam[ppu->oamaddr];
             break;
         case MN_PPU_PPUSCROLL:
@@ -804,7 +1224,7 @@ unsigned char mn_ppu_read(MNPPU *ppu, MNEmu *emu, unsigned short int reg) {
             v = ppu->read_buffer;
             /* The highest bit is unused for access through $2007. */
             addr = ppu->v&MN_PPU_BIT_RANGE(0, 14);
-            ppu->read_buffer = emu->mapper.vram_read(emu, &emu->mapper, addr);
+            ppu->read_buffer = mn_ppu_vram_read(ppu, emu, addr);
             ppu->io_bus = ppu->read_buffer;
             if((ppu->scanline < 240 || ppu->scanline == 261) &&
                (ppu->mask&MN_PPU_MASK_RENDER)){
@@ -814,12 +1234,12 @@ unsigned char mn_ppu_read(MNPPU *ppu, MNEmu *emu, unsigned short int reg) {
                 MN_PPU_BG_COARSE_X_INC();
                 MN_PPU_BG_Y_INC();
                 /* XXX: Is this a "load next value" as written in the wiki? */
-                 ppu->read_buffer = emu->mapper.
-                                    vram_read(emu, &emu->mapper,
-                                              ppu->v&MN_PPU_BIT_RANGE(0, 14));
+                 ppu->read_buffer = mn_ppu_vram_read(ppu, emu, ppu->v&
+                                                     MN_PPU_BIT_RANGE(0, 14));
                  ppu->io_bus = ppu->read_buffer;
             }else{
                 ppu->v += ppu->ctrl&MN_PPU_CTRL_INC ? 32 : 1;
+                ppu->v &= MN_PPU_BITS(15);
             }
             /* Palette reads are unbuffered (if the PPU supports palette
              * reads). */
@@ -841,11 +1261,21 @@ void mn_ppu_write(MNPPU *ppu, MNEmu *emu, unsigned short int reg,
                   unsigned char value) {
     ppu->io_bus = value;
 
+    MN_COUNT(emu, ppu_writes[reg]);
+
+#if MN_CONFIG_PPU_FAST_VBLANK
+    ppu->accessed = 1;
+#endif
+
     switch(reg){
         case MN_PPU_CTRL:
             if(ppu->since_start < ppu->startup_time) break;
             ppu->t &= ~(3<<10);
             ppu->t |= (value&3)<<10;
+            if((ppu->ctrl^value)&MN_PPU_CTRL_BIG_SPRITES){
+                MN_PPU_SYNC_EVAL();
+                MN_PPU_INVALIDATE_LINES();
+            }
             ppu->ctrl = value;
             break;
         case MN_PPU_MASK:
@@ -853,15 +1283,31 @@ void mn_ppu_write(MNPPU *ppu, MNEmu *emu, unsigned short int reg,
             /* TODO: Only toggle rendering after 3-4 dots */
             /* TODO: Take the bugs described at https://www.nesdev.org/wiki/PPU
              * _registers#Rendering_control into account. */
+            /* The buffered pixels use the old mask */
+            mn_ppu_flush_line(ppu);
+            if(((ppu->mask^value)&MN_PPU_MASK_EMPHASIS) &&
+               ppu->scanline < 240 && ppu->cycle > 1 && ppu->cycle <= 256 &&
+               !emu->skip_video){
+                mn_frame_set_emphasis(ppu->frame, ppu->scanline,
+                                      ppu->cycle-1, MN_FRAME_EMPHASIS(value));
+            }
+            if(!(ppu->mask&MN_PPU_MASK_RENDER) !=
+               !(value&MN_PPU_MASK_RENDER)){
+                MN_PPU_SYNC_EVAL();
+                mn_ppu_sync_sprites(ppu);
+            }
             ppu->mask = value;
             break;
         case MN_PPU_STATUS:
             break;
         case MN_PPU_OAMADDR:
             /* TODO: Emulate corruption */
+            MN_PPU_SYNC_EVAL();
             ppu->oamaddr = value;
             break;
         case MN_PPU_OAMDATA:
+            MN_PPU_SYNC_EVAL();
+            MN_PPU_INVALIDATE_LINES();
             ppu->primary_oam[ppu->oamaddr] = value;
             ppu->oamaddr++;
             break;
@@ -876,7 +1322,7 @@ void mn_ppu_write(MNPPU *ppu, MNEmu *emu, unsigned short int reg,
             }else{
                 ppu->t &= ~MN_PPU_BITS(5);
                 ppu->t |= (value>>3);
-                ppu->x = value;
+                ppu->x = value&7;
                 ppu->w = 1;
             }
             break;
@@ -898,9 +1344,8 @@ void mn_ppu_write(MNPPU *ppu, MNEmu *emu, unsigned short int reg,
 #if 0
             printf("%04x = %02x\n", ppu->v&((1<<15)-1), value);
 #endif
-            emu->mapper.vram_write(emu, &emu->mapper,
-                                   ppu->v&MN_PPU_BIT_RANGE(0, 14),
-                                   value);
+            mn_ppu_vram_write(ppu, emu, ppu->v&MN_PPU_BIT_RANGE(0, 14),
+                              value);
             if((ppu->scanline < 240 || ppu->scanline == 261) &&
                (ppu->mask&MN_PPU_MASK_RENDER)){
                 /* The PPU is rendering */
@@ -909,11 +1354,11 @@ void mn_ppu_write(MNPPU *ppu, MNEmu *emu, unsigned short int reg,
                 MN_PPU_BG_COARSE_X_INC();
                 MN_PPU_BG_Y_INC();
                 /* XXX: Is this a "load next value" as written in the wiki? */
-                ppu->io_bus = emu->mapper.vram_read(emu, &emu->mapper,
-                                                    ppu->v&MN_PPU_BIT_RANGE(0,
-                                                            14));
+                ppu->io_bus = mn_ppu_vram_read(ppu, emu,
+                                               ppu->v&MN_PPU_BIT_RANGE(0, 14));
             }else{
                 ppu->v += ppu->ctrl&MN_PPU_CTRL_INC ? 32 : 1;
+                ppu->v &= MN_PPU_BITS(15);
             }
             break;
     }
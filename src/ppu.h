@@ -57,6 +57,12 @@ enum {
     MN_PPU_CTRL_BIG_SPRITES = 1<<5
 };
 
+enum {
+    MN_PPU_STATUS_OVERFLOW = 1<<5,
+    MN_PPU_STATUS_SPRITE0_HIT = 1<<6,
+    MN_PPU_STATUS_VBLANK = 1<<7
+};
+
 enum {
     /* TODO: Add masks for all other flags */
     MN_PPU_MASK_GRAYSCALE = 1,
@@ -64,14 +70,18 @@ enum {
     MN_PPU_MASK_SPRITES_LEFTMOST_8PX = 1<<2,
     MN_PPU_MASK_BACKGROUND = 1<<3,
     MN_PPU_MASK_SPRITES = 1<<4,
+    MN_PPU_MASK_EMPHASIS = 7<<5,
     MN_PPU_MASK_RENDER = 3<<3  /* The ppu renders if one of the 3rd and the 4th
                                 * bits are on. If both are off a backdrop color
                                 * is shown. */
 };
 
-int mn_ppu_init(MNPPU *ppu, unsigned char *palette,
-                void draw_pixel(long int color));
+int mn_ppu_init(MNPPU *ppu, MNFrame *frame);
+void mn_ppu_decode_row(MNTileRow *row, unsigned char low, unsigned char high);
 void mn_ppu_cycle(MNPPU *ppu, MNEmu *emu);
+#if MN_CONFIG_PPU_FAST_VBLANK
+unsigned int mn_ppu_vblank(MNPPU *ppu, MNEmu *emu);
+#endif
 unsigned char mn_ppu_read(MNPPU *ppu, MNEmu *emu, unsigned short int reg);
 void mn_ppu_write(MNPPU *ppu, MNEmu *emu, unsigned short int reg,
                   unsigned char value);
@@ -32,34 +32,37 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 199309L
+
 #include <prof.h>
 
 #if MN_CONFIG_PROF
 
 #include <stddef.h>
+#include <time.h>
 
 /* Define counters here */
 
-counter_t mn_prof_emu_step;
+MNProfCounter mn_prof_emu_step;
 
-counter_t mn_prof_cpu_cycle;
+MNProfCounter mn_prof_cpu_cycle;
 
-counter_t mn_prof_ppu_cycle;
+MNProfCounter mn_prof_ppu_cycle;
 
-counter_t mn_prof_ppu_bg;
+MNProfCounter mn_prof_ppu_bg;
 
-counter_t mn_prof_ppu_bg_fetch;
-counter_t mn_prof_ppu_bg_get_pixel;
-counter_t mn_prof_ppu_bg_c_x_inc;
-counter_t mn_prof_ppu_bg_y_inc;
-counter_t mn_prof_ppu_bg_fill_regs;
-counter_t mn_prof_ppu_bg_shift;
+MNProfCounter mn_prof_ppu_bg_fetch;
+MNProfCounter mn_prof_ppu_bg_get_pixel;
+MNProfCounter mn_prof_ppu_bg_c_x_inc;
+MNProfCounter mn_prof_ppu_bg_y_inc;
+MNProfCounter mn_prof_ppu_bg_fill_regs;
+MNProfCounter mn_prof_ppu_bg_shift;
 
-counter_t mn_prof_ppu_oam;
+MNProfCounter mn_prof_ppu_oam;
 
-counter_t mn_prof_ppu_draw_pixel;
+MNProfCounter mn_prof_ppu_draw_pixel;
 
-static counter_t *const counters[] = {
+static MNProfCounter *const counters[] = {
     &mn_prof_emu_step,
 
     &mn_prof_cpu_cycle,
@@ -103,30 +106,103 @@ static char *const counter_names[] = {
     NULL
 };
 
-/* Initialization code */
+/* Time spent outside of all scopes */
+static MNProfCounter mn_prof_root;
+
+MNProfCounter *mn_prof_current = &mn_prof_root;
+unsigned long int mn_prof_entries;
+
+/* Only used for calibration */
+MNProfCounter mn_prof_calib_outer;
+MNProfCounter mn_prof_calib_inner;
+
+#define MN_PROF_CALIB_HITS   10000
+#define MN_PROF_CALIB_ROUNDS 16
+
+/* Ticks measured inside of an empty scope */
+static double inner_overhead;
+/* Ticks an empty scope adds to the scope it is nested in */
+static double outer_overhead;
 
 static counter_t start;
+static unsigned long int start_ns;
+
+unsigned long int mn_prof_get_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_nsec+time.tv_sec*1000000000ul;
+}
+
+static void mn_prof_reset(MNProfCounter *counter) {
+    counter->total = 0;
+    counter->children = 0;
+    counter->hits = 0;
+    counter->child_hits = 0;
+    counter->nested_hits = 0;
+}
 
-unsigned long mn_gui_get_ns(void);
+static void mn_prof_calibrate(void) {
+    size_t i, n;
+    double inner, outer;
+
+    /* Use the fastest round, the others probably got interrupted. */
+    inner_overhead = -1;
+    outer_overhead = -1;
+    for(n=0;n<MN_PROF_CALIB_ROUNDS;n++){
+        mn_prof_reset(&mn_prof_calib_outer);
+        mn_prof_reset(&mn_prof_calib_inner);
+
+        MN_PROF(mn_prof_calib_outer, {
+            for(i=0;i<MN_PROF_CALIB_HITS;i++){
+                MN_PROF(mn_prof_calib_inner, {});
+            }
+        });
+
+        inner = (double)mn_prof_calib_inner.total/MN_PROF_CALIB_HITS;
+        outer = (double)mn_prof_calib_outer.total/MN_PROF_CALIB_HITS;
+        if(inner_overhead < 0 || inner < inner_overhead){
+            inner_overhead = inner;
+        }
+        if(outer_overhead < 0 || outer < outer_overhead){
+            outer_overhead = outer;
+        }
+    }
+}
+
+/* Initialization code */
 
 void mn_prof_init(void) {
     size_t i;
 
-    start = mn_gui_get_ns();
-
     for(i=0;counters[i] != NULL;i++){
-        *counters[i] = 0;
+        mn_prof_reset(counters[i]);
     }
+
+    mn_prof_calibrate();
+
+    mn_prof_reset(&mn_prof_root);
+    mn_prof_current = &mn_prof_root;
+    mn_prof_entries = 0;
+
+    start_ns = mn_prof_get_ns();
+    start = MN_PROF_TICKS();
 }
 
 /* Time logging code */
 
 void mn_prof_log(void) {
     size_t i;
+    MNProfCounter *counter;
+    double inclusive, self;
 
-    unsigned long int ns = mn_gui_get_ns()-start;
+    counter_t ticks = MN_PROF_TICKS()-start;
+    unsigned long int ns = mn_prof_get_ns()-start_ns;
+    double ns_per_tick = ticks ? (double)ns/(double)ticks : 0;
 
     fprintf(stderr, "Total time: %lu ns\n", ns);
+    fprintf(stderr, "Overhead per scope: %.01f ns inside, %.01f ns "
+            "outside\n", inner_overhead*ns_per_tick,
+            outer_overhead*ns_per_tick);
 
     if(sizeof(counter_t) < 6){
         fputs("Warning: durations shown below might be incorrect as overflows "
@@ -134,10 +210,28 @@ void mn_prof_log(void) {
     }
 
     fputs("TIME:\n", stderr);
+    fprintf(stderr, "%-16s %12s %8s %14s %8s %14s %8s\n", "", "hits", "incl.",
+            "incl. ns", "self", "self ns", "ns/hit");
     for(i=0;counters[i] != NULL && counter_names[i] != NULL;i++){
-        fprintf(stderr, "\033[2K%s\r\033[16C: %05.02f%% %lu ns\n",
-                counter_names[i], (double)*counters[i]/(double)ns*100,
-                *counters[i]);
+        counter = counters[i];
+
+        /* Remove the measurement overhead of this scope and of all the scopes
+         * nested in it. */
+        inclusive = counter->total-counter->hits*inner_overhead-
+                    counter->nested_hits*outer_overhead;
+        self = counter->total-counter->children-
+               counter->hits*inner_overhead-
+               counter->child_hits*(outer_overhead-inner_overhead);
+        if(inclusive < 0) inclusive = 0;
+        if(self < 0) self = 0;
+
+        inclusive *= ns_per_tick;
+        self *= ns_per_tick;
+
+        fprintf(stderr, "%-16s %12lu %7.02f%% %14.0f %7.02f%% %14.0f %8.02f\n",
+                counter_names[i], counter->hits, inclusive/ns*100, inclusive,
+                self/ns*100, self,
+                counter->hits ? inclusive/counter->hits : 0);
     }
 }
 
@@ -41,19 +41,57 @@
 
 typedef unsigned long int counter_t;
 
+typedef struct {
+    /* Ticks spent in the scope, including nested scopes */
+    counter_t total;
+    /* Ticks spent in the scopes directly nested in this one */
+    counter_t children;
+    unsigned long int hits;
+    /* Amount of times a scope was directly entered from this one */
+    unsigned long int child_hits;
+    /* Amount of times any scope was entered from inside this one */
+    unsigned long int nested_hits;
+} MNProfCounter;
+
+/* Reading a timestamp counter is a lot cheaper than a system call, and the
+ * scopes we profile often only last a few ns. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MN_PROF_TICKS() ((counter_t)__builtin_ia32_rdtsc())
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define MN_PROF_TICKS() \
+    __extension__ ({ \
+        counter_t mn_prof_ticks; \
+        __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(mn_prof_ticks)); \
+        mn_prof_ticks; \
+    })
+#else
+#define MN_PROF_TICKS() mn_prof_get_ns()
+#endif
+
+extern MNProfCounter *mn_prof_current;
+extern unsigned long int mn_prof_entries;
+
+unsigned long int mn_prof_get_ns(void);
+
 #define MN_PROF(counter, scope) \
     { \
-        unsigned long mn_gui_get_ns(void); \
+        extern MNProfCounter counter; \
  \
-        counter_t start; \
-        counter_t end; \
-        extern counter_t counter; \
+        MNProfCounter *mn_prof_parent = mn_prof_current; \
+        unsigned long int mn_prof_entries_start = mn_prof_entries++; \
+        counter_t mn_prof_time; \
  \
-        start = mn_gui_get_ns(); \
+        mn_prof_current = &counter; \
+        mn_prof_time = MN_PROF_TICKS(); \
         scope; \
-        end = mn_gui_get_ns(); \
+        mn_prof_time = MN_PROF_TICKS()-mn_prof_time; \
+        mn_prof_current = mn_prof_parent; \
  \
-        counter += end-start; \
+        counter.total += mn_prof_time; \
+        counter.hits++; \
+        counter.nested_hits += mn_prof_entries-mn_prof_entries_start-1; \
+        mn_prof_parent->children += mn_prof_time; \
+        mn_prof_parent->child_hits++; \
     }
 
 void mn_prof_init(void);
@@ -0,0 +1,149 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* For SA_RESTART */
+#define _XOPEN_SOURCE 600
+
+#include <telemetry.h>
+
+#if MN_CONFIG_TELEMETRY
+
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+static MNHistogram histograms[MN_TELEMETRY_AMOUNT];
+
+static char *const histogram_names[MN_TELEMETRY_AMOUNT] = {
+    "Emulation",
+    "Present",
+    "Wait"
+};
+
+static unsigned long int starts[MN_TELEMETRY_AMOUNT];
+
+static volatile sig_atomic_t log_requested;
+
+static unsigned long int mn_telemetry_get_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_nsec+time.tv_sec*1000000000ul;
+}
+
+static void mn_telemetry_signal(int sig) {
+    (void)sig;
+    log_requested = 1;
+}
+
+void mn_telemetry_init(void) {
+    struct sigaction action;
+
+    memset(histograms, 0, sizeof(histograms));
+    log_requested = 0;
+
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = mn_telemetry_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+void mn_telemetry_start(int histogram) {
+    starts[histogram] = mn_telemetry_get_ns();
+}
+
+void mn_telemetry_stop(int histogram) {
+    MNHistogram *h = histograms+histogram;
+    unsigned long int ns = mn_telemetry_get_ns()-starts[histogram];
+    unsigned long int bucket = ns/MN_TELEMETRY_BUCKET_NS;
+
+    if(bucket >= MN_TELEMETRY_BUCKETS) bucket = MN_TELEMETRY_BUCKETS-1;
+
+    h->buckets[bucket]++;
+    h->count++;
+    h->total += ns;
+    if(ns > h->max) h->max = ns;
+}
+
+void mn_telemetry_poll(void) {
+    if(log_requested){
+        log_requested = 0;
+        mn_telemetry_log(stderr);
+    }
+}
+
+/* Get the upper bound of the bucket containing the given percentile, in ms */
+static double mn_telemetry_percentile(MNHistogram *h, unsigned int percent) {
+    unsigned long int rank = (h->count*percent+99)/100;
+    unsigned long int seen = 0;
+    double ns;
+    size_t i;
+
+    if(rank < 1) rank = 1;
+
+    for(i=0;i<MN_TELEMETRY_BUCKETS;i++){
+        seen += h->buckets[i];
+        if(seen >= rank) break;
+    }
+
+    ns = (double)(i+1)*MN_TELEMETRY_BUCKET_NS;
+    /* The max is more precise */
+    if(ns > h->max) ns = h->max;
+
+    return ns/1e6;
+}
+
+void mn_telemetry_log(FILE *fp) {
+    size_t i;
+    MNHistogram *h;
+
+    fprintf(fp, "Frame times (%lu frames):\n",
+            histograms[MN_TELEMETRY_EMU].count);
+    fprintf(fp, "%-12s %9s %9s %9s %9s %9s\n", "ms", "mean", "p50", "p95",
+            "p99", "max");
+    for(i=0;i<MN_TELEMETRY_AMOUNT;i++){
+        h = histograms+i;
+        if(!h->count) continue;
+
+        fprintf(fp, "%-12s %9.03f %9.03f %9.03f %9.03f %9.03f\n",
+                histogram_names[i], h->total/h->count/1e6,
+                mn_telemetry_percentile(h, 50),
+                mn_telemetry_percentile(h, 95),
+                mn_telemetry_percentile(h, 99), h->max/1e6);
+    }
+}
+
+#else
+typedef int int_t;
+#endif
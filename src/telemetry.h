@@ -0,0 +1,97 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MN_TELEMETRY_H
+#define MN_TELEMETRY_H
+
+#if MN_CONFIG_TELEMETRY
+
+#include <stdio.h>
+
+/* Width of a bucket of the histograms in ns */
+#define MN_TELEMETRY_BUCKET_NS 50000
+/* The histograms cover 0 to 100 ms, longer times all end up in the last
+ * bucket, but the max is still tracked exactly. */
+#define MN_TELEMETRY_BUCKETS   2000
+
+enum {
+    /* Time spent emulating and drawing a frame */
+    MN_TELEMETRY_EMU,
+    /* Time spent sending the frame to the screen */
+    MN_TELEMETRY_PRESENT,
+    /* Time spent waiting for the next frame */
+    MN_TELEMETRY_WAIT,
+    MN_TELEMETRY_AMOUNT
+};
+
+typedef struct {
+    unsigned long int buckets[MN_TELEMETRY_BUCKETS];
+    unsigned long int count;
+    unsigned long int max;
+    double total;
+} MNHistogram;
+
+/* Start recording and report the statistics on SIGUSR1 */
+void mn_telemetry_init(void);
+#define MN_TELEMETRY_INIT() mn_telemetry_init()
+
+/* Measure the time between START and STOP. Each histogram may only be used
+ * by a single thread. */
+void mn_telemetry_start(int histogram);
+#define MN_TELEMETRY_START(histogram) mn_telemetry_start(histogram)
+
+void mn_telemetry_stop(int histogram);
+#define MN_TELEMETRY_STOP(histogram) mn_telemetry_stop(histogram)
+
+/* Log the statistics if they were requested with a signal. This is done here
+ * because a signal handler can't safely do any IO. */
+void mn_telemetry_poll(void);
+#define MN_TELEMETRY_POLL() mn_telemetry_poll()
+
+/* The histograms of other threads may be updated while logging, so the
+ * statistics of a frame may be partially included. */
+void mn_telemetry_log(FILE *fp);
+#define MN_TELEMETRY_LOG() mn_telemetry_log(stderr)
+
+#else
+
+#define MN_TELEMETRY_INIT()
+#define MN_TELEMETRY_START(histogram)
+#define MN_TELEMETRY_STOP(histogram)
+#define MN_TELEMETRY_POLL()
+#define MN_TELEMETRY_LOG()
+
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <trace.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+int mn_trace_init(MNTrace *trace) {
+    trace->records = NULL;
+    trace->mask = 0;
+    trace->pos = 0;
+    trace->enabled = 0;
+
+    return MN_TRACE_E_NONE;
+}
+
+int mn_trace_start(MNTrace *trace, unsigned long int size) {
+    unsigned long int real_size = 1;
+
+    /* The ring buffer size has to be a power of two to be able to wrap around
+     * with a mask. */
+    while(real_size < size) real_size <<= 1;
+
+    if(trace->records == NULL || trace->mask+1 != real_size){
+        free(trace->records);
+        trace->records = malloc(real_size*sizeof(MNTraceRecord));
+        if(trace->records == NULL){
+            trace->mask = 0;
+            trace->enabled = 0;
+
+            return MN_TRACE_E_ALLOC;
+        }
+        trace->mask = real_size-1;
+    }
+
+    trace->pos = 0;
+    trace->enabled = 1;
+
+    return MN_TRACE_E_NONE;
+}
+
+void mn_trace_stop(MNTrace *trace) {
+    trace->enabled = 0;
+}
+
+int mn_trace_save(MNTrace *trace, FILE *fp) {
+    unsigned char header[MN_TRACE_HEADER_SIZE];
+    unsigned char buffer[MN_TRACE_RECORD_SIZE];
+    unsigned long int i;
+    unsigned long int start = 0;
+
+    if(trace->records == NULL) return MN_TRACE_E_NONE;
+
+    memcpy(header, MN_TRACE_MAGIC, 4);
+    header[4] = MN_TRACE_VERSION;
+    header[5] = MN_TRACE_RECORD_SIZE;
+    header[6] = 0;
+    header[7] = 0;
+    if(fwrite(header, 1, MN_TRACE_HEADER_SIZE, fp) != MN_TRACE_HEADER_SIZE){
+        return MN_TRACE_E_IO;
+    }
+
+    /* Only the last mask+1 records are still in the buffer */
+    if(trace->pos > trace->mask+1) start = trace->pos-(trace->mask+1);
+
+    for(i=start;i<trace->pos;i++){
+        mn_trace_write_record(trace->records+(i&trace->mask), buffer);
+        if(fwrite(buffer, 1, MN_TRACE_RECORD_SIZE, fp) !=
+           MN_TRACE_RECORD_SIZE){
+            return MN_TRACE_E_IO;
+        }
+    }
+
+    return MN_TRACE_E_NONE;
+}
+
+void mn_trace_free(MNTrace *trace) {
+    free(trace->records);
+    trace->records = NULL;
+    trace->enabled = 0;
+}
+
+/* Records are stored in little endian to keep trace files portable. */
+
+void mn_trace_write_record(MNTraceRecord *record, unsigned char *buffer) {
+    unsigned long int cycles;
+    size_t i;
+
+    buffer[0] = record->pc;
+    buffer[1] = record->pc>>8;
+    buffer[2] = record->opcode;
+    buffer[3] = record->operands[0];
+    buffer[4] = record->operands[1];
+    buffer[5] = record->a;
+    buffer[6] = record->x;
+    buffer[7] = record->y;
+    buffer[8] = record->s;
+    buffer[9] = record->p;
+    buffer[10] = record->scanline;
+    buffer[11] = record->scanline>>8;
+    buffer[12] = record->dot;
+    buffer[13] = record->dot>>8;
+    /* The cycle count takes 8 bytes, whatever the size of a long is */
+    cycles = record->cycles;
+    for(i=14;i<22;i++){
+        buffer[i] = cycles&0xFF;
+        cycles >>= 8;
+    }
+}
+
+void mn_trace_read_record(MNTraceRecord *record, unsigned char *buffer) {
+    size_t i;
+
+    record->pc = buffer[0]|(buffer[1]<<8);
+    record->opcode = buffer[2];
+    record->operands[0] = buffer[3];
+    record->operands[1] = buffer[4];
+    record->a = buffer[5];
+    record->x = buffer[6];
+    record->y = buffer[7];
+    record->s = buffer[8];
+    record->p = buffer[9];
+    record->scanline = buffer[10]|(buffer[11]<<8);
+    record->dot = buffer[12]|(buffer[13]<<8);
+    record->cycles = 0;
+    for(i=21;i>=14;i--){
+        record->cycles = (record->cycles<<8)|buffer[i];
+    }
+}
+
+int mn_trace_read_header(FILE *fp) {
+    unsigned char header[MN_TRACE_HEADER_SIZE];
+
+    if(fread(header, 1, MN_TRACE_HEADER_SIZE, fp) != MN_TRACE_HEADER_SIZE){
+        return MN_TRACE_E_IO;
+    }
+    if(memcmp(header, MN_TRACE_MAGIC, 4) || header[4] != MN_TRACE_VERSION ||
+       header[5] != MN_TRACE_RECORD_SIZE){
+        return MN_TRACE_E_FORMAT;
+    }
+
+    return MN_TRACE_E_NONE;
+}
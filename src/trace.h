@@ -0,0 +1,114 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MN_TRACE_H
+#define MN_TRACE_H
+
+#include <stdio.h>
+
+#include <emu.h>
+
+#include <config.h>
+
+/* Size of a record once written to a file */
+#define MN_TRACE_RECORD_SIZE 22
+
+#define MN_TRACE_MAGIC "MNTR"
+#define MN_TRACE_VERSION 2
+#define MN_TRACE_HEADER_SIZE 8
+
+#if MN_CONFIG_TRACE
+
+/* Log the instruction that is about to be executed. This is called once per
+ * instruction, so it should stay as cheap as possible when tracing is
+ * disabled. */
+#define MN_TRACE_OP(emu) \
+    { \
+        if((emu)->trace.enabled){ \
+            register MNTraceRecord *rec = (emu)->trace.records+ \
+                                          ((emu)->trace.pos& \
+                                           (emu)->trace.mask); \
+ \
+            rec->pc = (emu)->cpu.pc; \
+            rec->opcode = (emu)->cpu.opcode; \
+            rec->a = (emu)->cpu.a; \
+            rec->x = (emu)->cpu.x; \
+            rec->y = (emu)->cpu.y; \
+            rec->s = (emu)->cpu.s; \
+            rec->p = (emu)->cpu.p; \
+            rec->scanline = (emu)->ppu.scanline; \
+            rec->dot = (emu)->ppu.cycle; \
+            /* The current cycle has already been counted */ \
+            rec->cycles = (emu)->cpu.cycles-1; \
+ \
+            (emu)->trace.pos++; \
+        } \
+    }
+
+/* Store the n-th operand of the last logged instruction. */
+#define MN_TRACE_OPERAND(emu, n, value) \
+    { \
+        if((emu)->trace.enabled && (emu)->trace.pos){ \
+            (emu)->trace.records[((emu)->trace.pos-1)& \
+                                 (emu)->trace.mask].operands[n] = value; \
+        } \
+    }
+
+#else
+
+#define MN_TRACE_OP(emu)
+#define MN_TRACE_OPERAND(emu, n, value)
+
+#endif
+
+enum {
+    MN_TRACE_E_NONE,
+    MN_TRACE_E_ALLOC,
+    MN_TRACE_E_IO,
+    MN_TRACE_E_FORMAT,
+
+    MN_TRACE_E_AMOUNT
+};
+
+int mn_trace_init(MNTrace *trace);
+int mn_trace_start(MNTrace *trace, unsigned long int size);
+void mn_trace_stop(MNTrace *trace);
+int mn_trace_save(MNTrace *trace, FILE *fp);
+void mn_trace_free(MNTrace *trace);
+
+void mn_trace_write_record(MNTraceRecord *record, unsigned char *buffer);
+void mn_trace_read_record(MNTraceRecord *record, unsigned char *buffer);
+int mn_trace_read_header(FILE *fp);
+
+#endif /* MN_TRACE_H */
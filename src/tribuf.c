@@ -0,0 +1,92 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tribuf.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+int mn_tribuf_init(MNTriBuf *tribuf, size_t size) {
+    size_t i;
+
+    for(i=0;i<3;i++){
+        tribuf->buffers[i] = malloc(size);
+        if(tribuf->buffers[i] == NULL){
+            while(i--) free(tribuf->buffers[i]);
+
+            return MN_TRIBUF_E_ALLOC;
+        }
+        memset(tribuf->buffers[i], 0, size);
+    }
+
+    tribuf->write = 0;
+    tribuf->latest = 1;
+    tribuf->read = 2;
+
+    return MN_TRIBUF_E_NONE;
+}
+
+void mn_tribuf_publish(MNTriBuf *tribuf) {
+    unsigned int old;
+
+    old = __atomic_exchange_n(&tribuf->latest,
+                              tribuf->write | MN_TRIBUF_FRESH,
+                              __ATOMIC_ACQ_REL);
+    tribuf->write = old & ~MN_TRIBUF_FRESH;
+}
+
+int mn_tribuf_acquire(MNTriBuf *tribuf) {
+    unsigned int old;
+
+    if(!(__atomic_load_n(&tribuf->latest, __ATOMIC_RELAXED) &
+         MN_TRIBUF_FRESH)){
+        return 0;
+    }
+
+    /* Only the producer can set the fresh bit, so it is still set */
+    old = __atomic_exchange_n(&tribuf->latest, tribuf->read,
+                              __ATOMIC_ACQ_REL);
+    tribuf->read = old & ~MN_TRIBUF_FRESH;
+
+    return 1;
+}
+
+void mn_tribuf_free(MNTriBuf *tribuf) {
+    size_t i;
+
+    for(i=0;i<3;i++){
+        free(tribuf->buffers[i]);
+        tribuf->buffers[i] = NULL;
+    }
+}
@@ -0,0 +1,79 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MN_TRIBUF_H
+#define MN_TRIBUF_H
+
+#include <stddef.h>
+
+/* Lock-free triple buffer to pass frames from a single producer to a single
+ * consumer. The producer always has a buffer to write to and the consumer
+ * always gets the most recent complete frame, so neither of them ever has to
+ * wait for the other one. */
+
+/* Set in latest when it has not been acquired by the consumer yet */
+#define MN_TRIBUF_FRESH 4
+
+typedef struct {
+    unsigned char *buffers[3];
+    /* Owned by the producer */
+    unsigned int write;
+    /* Owned by the consumer */
+    unsigned int read;
+    /* Shared, only accessed atomically */
+    unsigned int latest;
+} MNTriBuf;
+
+enum {
+    MN_TRIBUF_E_NONE,
+    MN_TRIBUF_E_ALLOC
+};
+
+int mn_tribuf_init(MNTriBuf *tribuf, size_t size);
+
+/* Get the buffer the producer should write to */
+#define MN_TRIBUF_WRITE_BUFFER(tribuf) ((tribuf)->buffers[(tribuf)->write])
+
+/* Get the buffer last acquired by the consumer */
+#define MN_TRIBUF_READ_BUFFER(tribuf) ((tribuf)->buffers[(tribuf)->read])
+
+/* Publish the write buffer and get a new one to write to */
+void mn_tribuf_publish(MNTriBuf *tribuf);
+
+/* Acquire the most recent frame. Returns 0 if there is no new frame. */
+int mn_tribuf_acquire(MNTriBuf *tribuf);
+
+void mn_tribuf_free(MNTriBuf *tribuf);
+
+#endif
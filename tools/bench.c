@@ -0,0 +1,582 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Micro-benchmarks for the hot paths of the emulator core. Every benchmark
+ * is run several times and the time per operation of each run is used to
+ * compute percentiles, to get numbers that are stable enough to be compared
+ * between commits. */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <emu.h>
+#include <cpu.h>
+#include <ppu.h>
+#include <mux.h>
+#include <frame.h>
+
+#define PRG_SIZE 0x8000
+#define CHR_SIZE 0x2000
+#define ROM_SIZE (16+PRG_SIZE+CHR_SIZE)
+
+#define DEFAULT_SAMPLES 200
+
+typedef struct {
+    char *name;
+    /* Prepare emu before running the benchmark */
+    int (*setup)(const void *arg);
+    /* Called before each sample without being measured, can be NULL */
+    void (*prepare)(const void *arg);
+    /* Perform ops operations */
+    void (*run)(const void *arg, unsigned long int ops);
+    const void *arg;
+    unsigned long int ops;
+    /* The name of the SIMD kernel measured, can be NULL */
+    const char *(*kernel)(void);
+} MNBench;
+
+typedef struct {
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+    double mean;
+} MNBenchResult;
+
+extern MNCtrl mn_nesctrl;
+
+static MNEmu emu;
+static unsigned char rom[ROM_SIZE];
+static unsigned char palette[0x600];
+
+static volatile long int sink;
+
+static unsigned char mn_bench_input(void) {
+    return 0;
+}
+
+static unsigned long int mn_bench_get_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_nsec+time.tv_sec*1000000000ul;
+}
+
+/* Build an NROM image that executes code over and over again, filling the
+ * whole PRG ROM. */
+static int mn_bench_load(const unsigned char *code, size_t size) {
+    size_t i;
+    unsigned char *prg = rom+16;
+    unsigned char *chr = prg+PRG_SIZE;
+    unsigned long int seed = 1;
+
+    memset(rom, 0, 16);
+    memcpy(rom, "NES\x1A", 4);
+    rom[4] = PRG_SIZE/0x4000;
+    rom[5] = CHR_SIZE/0x2000;
+
+    for(i=0;i+size<=PRG_SIZE-0x10;i+=size){
+        memcpy(prg+i, code, size);
+    }
+    /* JMP $8000 */
+    prg[i] = 0x4C;
+    prg[i+1] = 0x00;
+    prg[i+2] = 0x80;
+
+    /* Point all vectors to $8000 */
+    for(i=PRG_SIZE-6;i<PRG_SIZE;i+=2){
+        prg[i] = 0x00;
+        prg[i+1] = 0x80;
+    }
+
+    for(i=0;i<CHR_SIZE;i++){
+        chr[i] = mn_mapper_rand(&seed);
+    }
+
+    if(mn_emu_init(&emu, mn_bench_input, mn_bench_input, mn_nesctrl,
+                   mn_nesctrl, rom, palette, ROM_SIZE, 0)){
+        return 1;
+    }
+
+    /* Skip the PPU warm up time */
+    emu.ppu.since_start = emu.ppu.startup_time;
+
+    /* ($10) points to $0300 for the indirect addressing modes */
+    emu.mapper.write(&emu, &emu.mapper, 0x10, 0x00);
+    emu.mapper.write(&emu, &emu.mapper, 0x11, 0x03);
+
+    emu.cpu.x = 0;
+    emu.cpu.y = 0;
+
+    return 0;
+}
+
+/* CPU benchmarks, one per addressing mode macro family */
+
+typedef struct {
+    unsigned char code[3];
+    size_t size;
+} MNBenchCode;
+
+static const MNBenchCode cpu_imp = {{0xE8}, 1};               /* INX */
+static const MNBenchCode cpu_imm = {{0xA9, 0x00}, 2};         /* LDA # */
+static const MNBenchCode cpu_zp_read = {{0xA5, 0x20}, 2};     /* LDA zp */
+static const MNBenchCode cpu_zp_rmw = {{0xE6, 0x20}, 2};      /* INC zp */
+static const MNBenchCode cpu_zp_store = {{0x85, 0x20}, 2};    /* STA zp */
+static const MNBenchCode cpu_zpi_read = {{0xB5, 0x20}, 2};    /* LDA zp,X */
+static const MNBenchCode cpu_zpi_rmw = {{0xF6, 0x20}, 2};     /* INC zp,X */
+static const MNBenchCode cpu_zpi_store = {{0x95, 0x20}, 2};   /* STA zp,X */
+static const MNBenchCode cpu_abs_read = {{0xAD, 0x00, 0x03}, 3};
+static const MNBenchCode cpu_abs_rmw = {{0xEE, 0x00, 0x03}, 3};
+static const MNBenchCode cpu_abs_store = {{0x8D, 0x00, 0x03}, 3};
+static const MNBenchCode cpu_absi_read = {{0xBD, 0x00, 0x03}, 3};
+static const MNBenchCode cpu_absi_rmw = {{0xFE, 0x00, 0x03}, 3};
+static const MNBenchCode cpu_absi_store = {{0x9D, 0x00, 0x03}, 3};
+static const MNBenchCode cpu_absi_sh = {{0x9C, 0x00, 0x03}, 3}; /* SHY */
+static const MNBenchCode cpu_relative = {{0xD0, 0x00}, 2};    /* BNE +0 */
+static const MNBenchCode cpu_idxind_read = {{0xA1, 0x10}, 2};
+static const MNBenchCode cpu_idxind_rmw = {{0x03, 0x10}, 2};  /* SLO */
+static const MNBenchCode cpu_idxind_store = {{0x81, 0x10}, 2};
+static const MNBenchCode cpu_indidx_read = {{0xB1, 0x10}, 2};
+static const MNBenchCode cpu_indidx_rmw = {{0x13, 0x10}, 2};  /* SLO */
+static const MNBenchCode cpu_indidx_store = {{0x91, 0x10}, 2};
+static const MNBenchCode cpu_indidx_sh = {{0x93, 0x10}, 2};   /* AHX */
+
+static int mn_bench_cpu_setup(const void *arg) {
+    const MNBenchCode *code = arg;
+
+    return mn_bench_load(code->code, code->size);
+}
+
+static void mn_bench_cpu_run(const void *arg, unsigned long int ops) {
+    unsigned long int i;
+    (void)arg;
+
+    for(i=0;i<ops;i++){
+        mn_cpu_cycle(&emu.cpu, &emu);
+    }
+}
+
+/* PPU benchmarks */
+
+typedef struct {
+    unsigned char mask;
+    /* Amount of sprites on scanlines 100-107, or -1 to emulate whole frames
+     * without sprites */
+    int sprites;
+    /* Emulate frames that are not displayed */
+    int skip_video;
+} MNBenchPPU;
+
+static const MNBenchPPU ppu_render_off = {0x00, -1, 0};
+static const MNBenchPPU ppu_render_on = {0x1E, -1, 0};
+static const MNBenchPPU ppu_bg_only = {0x0A, -1, 0};
+static const MNBenchPPU ppu_render_skip = {0x1E, -1, 1};
+static const MNBenchPPU ppu_sprites_0 = {0x1E, 0, 0};
+static const MNBenchPPU ppu_sprites_8 = {0x1E, 8, 0};
+static const MNBenchPPU ppu_sprites_64 = {0x1E, 64, 0};
+
+static int mn_bench_ppu_setup(const void *arg) {
+    const MNBenchPPU *ppu = arg;
+    static const unsigned char nop = 0xEA;
+    int i;
+
+    if(mn_bench_load(&nop, 1)) return 1;
+
+    /* Only measure the PPU */
+    emu.cpu.jammed = 1;
+
+    emu.ppu.mask = ppu->mask;
+    emu.ppu.ctrl = 0;
+    emu.skip_video = ppu->skip_video;
+
+    for(i=0;i<64;i++){
+        emu.ppu.primary_oam[i*4] = i < ppu->sprites ? 100 : 0xFF;
+        emu.ppu.primary_oam[i*4+1] = i;
+        emu.ppu.primary_oam[i*4+2] = i&3;
+        emu.ppu.primary_oam[i*4+3] = i*3;
+    }
+
+    return 0;
+}
+
+static void mn_bench_ppu_prepare(const void *arg) {
+    const MNBenchPPU *ppu = arg;
+
+    if(ppu->sprites >= 0){
+        /* Go to the start of scanline 100 */
+        while(emu.ppu.scanline != 100 || emu.ppu.cycle){
+            mn_ppu_cycle(&emu.ppu, &emu);
+        }
+    }
+}
+
+static void mn_bench_ppu_run(const void *arg, unsigned long int ops) {
+    unsigned long int i;
+    (void)arg;
+
+    for(i=0;i<ops;i++){
+        mn_ppu_cycle(&emu.ppu, &emu);
+    }
+}
+
+/* Frame conversion benchmark, one op is one frame */
+
+static unsigned int frame_out[MN_FRAME_WIDTH*MN_FRAME_HEIGHT];
+
+static int mn_bench_frame_setup(const void *arg) {
+    static const unsigned char nop = 0xEA;
+    unsigned long int seed = 1;
+    size_t i;
+    (void)arg;
+
+    if(mn_bench_load(&nop, 1)) return 1;
+
+    for(i=0;i<MN_FRAME_HEIGHT;i++){
+        emu.frame.lines[i] = i&7;
+    }
+    for(i=0;i<sizeof(emu.frame.pixels);i++){
+        ((unsigned char*)emu.frame.pixels)[i] = mn_mapper_rand(&seed)&0x3F;
+    }
+
+    return 0;
+}
+
+static void mn_bench_frame_run(const void *arg, unsigned long int ops) {
+    unsigned long int i;
+    (void)arg;
+
+    for(i=0;i<ops;i++){
+        mn_frame_convert(&emu.frame, frame_out);
+    }
+
+    sink = frame_out[0];
+}
+
+/* Whole emulator benchmark, one op is one frame */
+
+static int mn_bench_emu_setup(const void *arg) {
+    static const unsigned char nop = 0xEA;
+    (void)arg;
+
+    if(mn_bench_load(&nop, 1)) return 1;
+
+    emu.ppu.mask = 0x1E;
+
+    return 0;
+}
+
+static void mn_bench_emu_run(const void *arg, unsigned long int ops) {
+    unsigned long int i;
+    (void)arg;
+
+    for(i=0;i<ops;i++){
+        mn_emu_frame(&emu);
+    }
+}
+
+/* Mapper benchmarks */
+
+enum {
+    MN_BENCH_RAM_READ,
+    MN_BENCH_RAM_WRITE,
+    MN_BENCH_PRG_READ,
+    MN_BENCH_CHR_READ,
+    MN_BENCH_NAMETABLE_READ
+};
+
+static const int mapper_ram_read = MN_BENCH_RAM_READ;
+static const int mapper_ram_write = MN_BENCH_RAM_WRITE;
+static const int mapper_prg_read = MN_BENCH_PRG_READ;
+static const int mapper_chr_read = MN_BENCH_CHR_READ;
+static const int mapper_nametable_read = MN_BENCH_NAMETABLE_READ;
+
+static int mn_bench_mapper_setup(const void *arg) {
+    static const unsigned char nop = 0xEA;
+    (void)arg;
+
+    return mn_bench_load(&nop, 1);
+}
+
+static void mn_bench_mapper_run(const void *arg, unsigned long int ops) {
+    unsigned long int i;
+    unsigned char v = 0;
+
+    switch(*(const int*)arg){
+        case MN_BENCH_RAM_READ:
+            for(i=0;i<ops;i++){
+                v += emu.mapper.read(&emu, &emu.mapper, i&0x7FF);
+            }
+            break;
+        case MN_BENCH_RAM_WRITE:
+            for(i=0;i<ops;i++){
+                emu.mapper.write(&emu, &emu.mapper, i&0x7FF, i);
+            }
+            break;
+        case MN_BENCH_PRG_READ:
+            for(i=0;i<ops;i++){
+                v += emu.mapper.read(&emu, &emu.mapper, 0x8000|(i&0x7FFF));
+            }
+            break;
+        case MN_BENCH_CHR_READ:
+            for(i=0;i<ops;i++){
+                v += emu.mapper.vram_read(&emu, &emu.mapper, i&0x1FFF);
+            }
+            break;
+        case MN_BENCH_NAMETABLE_READ:
+            for(i=0;i<ops;i++){
+                v += emu.mapper.vram_read(&emu, &emu.mapper,
+                                          0x2000|(i&0xFFF));
+            }
+            break;
+    }
+
+    sink = v;
+}
+
+#define MN_BENCH_CPU(name) \
+    {"cpu/" #name, mn_bench_cpu_setup, NULL, mn_bench_cpu_run, &cpu_##name, \
+     20000, NULL}
+#define MN_BENCH_PPU(name, ops) \
+    {"ppu/" #name, mn_bench_ppu_setup, mn_bench_ppu_prepare, \
+     mn_bench_ppu_run, &ppu_##name, ops, mn_mux_kernel}
+#define MN_BENCH_MAPPER(name) \
+    {"mapper/" #name, mn_bench_mapper_setup, NULL, mn_bench_mapper_run, \
+     &mapper_##name, 50000, NULL}
+
+static const MNBench benchmarks[] = {
+    MN_BENCH_CPU(imp),
+    MN_BENCH_CPU(imm),
+    MN_BENCH_CPU(zp_read),
+    MN_BENCH_CPU(zp_rmw),
+    MN_BENCH_CPU(zp_store),
+    MN_BENCH_CPU(zpi_read),
+    MN_BENCH_CPU(zpi_rmw),
+    MN_BENCH_CPU(zpi_store),
+    MN_BENCH_CPU(abs_read),
+    MN_BENCH_CPU(abs_rmw),
+    MN_BENCH_CPU(abs_store),
+    MN_BENCH_CPU(absi_read),
+    MN_BENCH_CPU(absi_rmw),
+    MN_BENCH_CPU(absi_store),
+    MN_BENCH_CPU(absi_sh),
+    MN_BENCH_CPU(relative),
+    MN_BENCH_CPU(idxind_read),
+    MN_BENCH_CPU(idxind_rmw),
+    MN_BENCH_CPU(idxind_store),
+    MN_BENCH_CPU(indidx_read),
+    MN_BENCH_CPU(indidx_rmw),
+    MN_BENCH_CPU(indidx_store),
+    MN_BENCH_CPU(indidx_sh),
+
+    /* One full frame */
+    MN_BENCH_PPU(render_off, 341*262),
+    MN_BENCH_PPU(render_on, 341*262),
+    MN_BENCH_PPU(bg_only, 341*262),
+    MN_BENCH_PPU(render_skip, 341*262),
+    /* Scanlines 100 to 107 */
+    MN_BENCH_PPU(sprites_0, 341*8),
+    MN_BENCH_PPU(sprites_8, 341*8),
+    MN_BENCH_PPU(sprites_64, 341*8),
+
+    {"frame/convert", mn_bench_frame_setup, NULL, mn_bench_frame_run, NULL,
+     4, mn_frame_kernel},
+
+    {"emu/frame", mn_bench_emu_setup, NULL, mn_bench_emu_run, NULL, 4,
+     NULL},
+
+    MN_BENCH_MAPPER(ram_read),
+    MN_BENCH_MAPPER(ram_write),
+    MN_BENCH_MAPPER(prg_read),
+    MN_BENCH_MAPPER(chr_read),
+    MN_BENCH_MAPPER(nametable_read),
+
+    {NULL, NULL, NULL, NULL, NULL, 0, NULL}
+};
+
+static int mn_bench_compare(const void *a, const void *b) {
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+
+    return (da > db)-(da < db);
+}
+
+/* Nearest-rank percentile of a sorted array */
+static double mn_bench_percentile(double *samples, size_t count,
+                                  unsigned int percent) {
+    size_t rank = (count*percent+99)/100;
+
+    if(rank < 1) rank = 1;
+    return samples[rank-1];
+}
+
+static int mn_bench_run(const MNBench *bench, size_t count,
+                        MNBenchResult *result) {
+    double *samples;
+    unsigned long int start;
+    size_t i;
+    double total = 0;
+
+    samples = malloc(count*sizeof(double));
+    if(samples == NULL) return 1;
+
+    if(bench->setup(bench->arg)){
+        free(samples);
+        return 1;
+    }
+
+    /* Warm up the caches and the branch predictor */
+    if(bench->prepare != NULL) bench->prepare(bench->arg);
+    bench->run(bench->arg, bench->ops);
+
+    for(i=0;i<count;i++){
+        if(bench->prepare != NULL) bench->prepare(bench->arg);
+        start = mn_bench_get_ns();
+        bench->run(bench->arg, bench->ops);
+        samples[i] = (double)(mn_bench_get_ns()-start)/bench->ops;
+        total += samples[i];
+    }
+
+    mn_emu_free(&emu);
+
+    qsort(samples, count, sizeof(double), mn_bench_compare);
+
+    result->min = samples[0];
+    result->p50 = mn_bench_percentile(samples, count, 50);
+    result->p90 = mn_bench_percentile(samples, count, 90);
+    result->p99 = mn_bench_percentile(samples, count, 99);
+    result->max = samples[count-1];
+    result->mean = total/count;
+
+    free(samples);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t i;
+    size_t count = DEFAULT_SAMPLES;
+    char *filter = NULL;
+    char *json_file = NULL;
+    FILE *json = NULL;
+    int first = 1;
+    MNBenchResult result;
+    const char *kernel;
+    char label[64];
+
+    for(i=1;i<(size_t)argc;i++){
+        if(!strcmp(argv[i], "-j") && i+1 < (size_t)argc){
+            json_file = argv[++i];
+        }else if(!strcmp(argv[i], "-s") && i+1 < (size_t)argc){
+            count = strtoul(argv[++i], NULL, 10);
+        }else if(argv[i][0] != '-'){
+            filter = argv[i];
+        }else{
+            fprintf(stderr, "USAGE: %s [-j JSON] [-s SAMPLES] [FILTER]\n"
+                    "Benchmarks the hot paths of MibiNES\n\n"
+                    "Options:\n"
+                    "-j  Also write the results to a JSON file\n"
+                    "-s  Amount of samples taken for each benchmark\n\n"
+                    "Only the benchmarks starting with FILTER are run if it "
+                    "is given.\n", argv[0]);
+
+            return EXIT_FAILURE;
+        }
+    }
+    if(!count) count = 1;
+
+    if(json_file != NULL){
+        json = fopen(json_file, "w");
+        if(json == NULL){
+            fprintf(stderr, "%s: Failed to open \"%s\"!\n", argv[0],
+                    json_file);
+
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\n    \"unit\": \"ns/op\",\n    \"samples\": %lu,\n"
+                "    \"benchmarks\": [", (unsigned long int)count);
+    }
+
+    printf("%-24s %9s %9s %9s %9s %9s %9s\n", "ns/op", "min", "p50", "p90",
+           "p99", "max", "mean");
+
+    for(i=0;benchmarks[i].name != NULL;i++){
+        if(filter != NULL && strncmp(benchmarks[i].name, filter,
+                                     strlen(filter))){
+            continue;
+        }
+
+        if(mn_bench_run(benchmarks + i, count, &result)){
+            fprintf(stderr, "%s: Failed to run %s!\n", argv[0],
+                    benchmarks[i].name);
+            continue;
+        }
+
+        /* The kernel is only picked once the emulator is initialized */
+        kernel = benchmarks[i].kernel != NULL ? benchmarks[i].kernel() : NULL;
+        if(kernel != NULL){
+            sprintf(label, "%.40s [%.16s]", benchmarks[i].name, kernel);
+        }else{
+            sprintf(label, "%.40s", benchmarks[i].name);
+        }
+
+        printf("%-24s %9.02f %9.02f %9.02f %9.02f %9.02f %9.02f\n",
+               label, result.min, result.p50, result.p90, result.p99,
+               result.max, result.mean);
+        fflush(stdout);
+
+        if(json != NULL){
+            fprintf(json, "%s\n        {\"name\": \"%s\", ",
+                    first ? "" : ",", benchmarks[i].name);
+            if(kernel != NULL) fprintf(json, "\"kernel\": \"%s\", ", kernel);
+            fprintf(json, "\"ops\": %lu, "
+                    "\"min\": %.03f, \"p50\": %.03f, \"p90\": %.03f, "
+                    "\"p99\": %.03f, \"max\": %.03f, \"mean\": %.03f}",
+                    benchmarks[i].ops, result.min, result.p50, result.p90,
+                    result.p99, result.max, result.mean);
+            first = 0;
+        }
+    }
+
+    if(json != NULL){
+        fputs("\n    ]\n}\n", json);
+        fclose(json);
+    }
+
+    return EXIT_SUCCESS;
+}
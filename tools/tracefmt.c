@@ -0,0 +1,439 @@
+/* mibines - A small NES emulator.
+ * by Mibi88
+ *
+ * This software is licensed under the BSD-3-Clause license:
+ *
+ * Copyright 2025 Mibi88
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Formats binary CPU traces saved by the emulator as text, using the same
+ * layout as nestest.log to make traces easy to diff against other
+ * emulators. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <trace.h>
+
+enum {
+    MN_TRACEFMT_IMP,
+    MN_TRACEFMT_ACC,
+    MN_TRACEFMT_IMM,
+    MN_TRACEFMT_ZP,
+    MN_TRACEFMT_ZPX,
+    MN_TRACEFMT_ZPY,
+    MN_TRACEFMT_ABS,
+    MN_TRACEFMT_ABX,
+    MN_TRACEFMT_ABY,
+    MN_TRACEFMT_IND,
+    MN_TRACEFMT_IZX,
+    MN_TRACEFMT_IZY,
+    MN_TRACEFMT_REL,
+
+    MN_TRACEFMT_AMOUNT
+};
+
+/* Instruction size for each addressing mode */
+static const unsigned char sizes[MN_TRACEFMT_AMOUNT] = {
+    1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2
+};
+
+static const struct {
+    char *name;
+    unsigned char mode;
+    unsigned char official;
+} opcodes[256] = {
+    {"BRK", MN_TRACEFMT_IMP, 1},
+    {"ORA", MN_TRACEFMT_IZX, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"SLO", MN_TRACEFMT_IZX, 0},
+    {"NOP", MN_TRACEFMT_ZP, 0},
+    {"ORA", MN_TRACEFMT_ZP, 1},
+    {"ASL", MN_TRACEFMT_ZP, 1},
+    {"SLO", MN_TRACEFMT_ZP, 0},
+    {"PHP", MN_TRACEFMT_IMP, 1},
+    {"ORA", MN_TRACEFMT_IMM, 1},
+    {"ASL", MN_TRACEFMT_ACC, 1},
+    {"ANC", MN_TRACEFMT_IMM, 0},
+    {"NOP", MN_TRACEFMT_ABS, 0},
+    {"ORA", MN_TRACEFMT_ABS, 1},
+    {"ASL", MN_TRACEFMT_ABS, 1},
+    {"SLO", MN_TRACEFMT_ABS, 0},
+    {"BPL", MN_TRACEFMT_REL, 1},
+    {"ORA", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"SLO", MN_TRACEFMT_IZY, 0},
+    {"NOP", MN_TRACEFMT_ZPX, 0},
+    {"ORA", MN_TRACEFMT_ZPX, 1},
+    {"ASL", MN_TRACEFMT_ZPX, 1},
+    {"SLO", MN_TRACEFMT_ZPX, 0},
+    {"CLC", MN_TRACEFMT_IMP, 1},
+    {"ORA", MN_TRACEFMT_ABY, 1},
+    {"NOP", MN_TRACEFMT_IMP, 0},
+    {"SLO", MN_TRACEFMT_ABY, 0},
+    {"NOP", MN_TRACEFMT_ABX, 0},
+    {"ORA", MN_TRACEFMT_ABX, 1},
+    {"ASL", MN_TRACEFMT_ABX, 1},
+    {"SLO", MN_TRACEFMT_ABX, 0},
+    {"JSR", MN_TRACEFMT_ABS, 1},
+    {"AND", MN_TRACEFMT_IZX, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"RLA", MN_TRACEFMT_IZX, 0},
+    {"BIT", MN_TRACEFMT_ZP, 1},
+    {"AND", MN_TRACEFMT_ZP, 1},
+    {"ROL", MN_TRACEFMT_ZP, 1},
+    {"RLA", MN_TRACEFMT_ZP, 0},
+    {"PLP", MN_TRACEFMT_IMP, 1},
+    {"AND", MN_TRACEFMT_IMM, 1},
+    {"ROL", MN_TRACEFMT_ACC, 1},
+    {"ANC", MN_TRACEFMT_IMM, 0},
+    {"BIT", MN_TRACEFMT_ABS, 1},
+    {"AND", MN_TRACEFMT_ABS, 1},
+    {"ROL", MN_TRACEFMT_ABS, 1},
+    {"RLA", MN_TRACEFMT_ABS, 0},
+    {"BMI", MN_TRACEFMT_REL, 1},
+    {"AND", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"RLA", MN_TRACEFMT_IZY, 0},
+    {"NOP", MN_TRACEFMT_ZPX, 0},
+    {"AND", MN_TRACEFMT_ZPX, 1},
+    {"ROL", MN_TRACEFMT_ZPX, 1},
+    {"RLA", MN_TRACEFMT_ZPX, 0},
+    {"SEC", MN_TRACEFMT_IMP, 1},
+    {"AND", MN_TRACEFMT_ABY, 1},
+    {"NOP", MN_TRACEFMT_IMP, 0},
+    {"RLA", MN_TRACEFMT_ABY, 0},
+    {"NOP", MN_TRACEFMT_ABX, 0},
+    {"AND", MN_TRACEFMT_ABX, 1},
+    {"ROL", MN_TRACEFMT_ABX, 1},
+    {"RLA", MN_TRACEFMT_ABX, 0},
+    {"RTI", MN_TRACEFMT_IMP, 1},
+    {"EOR", MN_TRACEFMT_IZX, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"SRE", MN_TRACEFMT_IZX, 0},
+    {"NOP", MN_TRACEFMT_ZP, 0},
+    {"EOR", MN_TRACEFMT_ZP, 1},
+    {"LSR", MN_TRACEFMT_ZP, 1},
+    {"SRE", MN_TRACEFMT_ZP, 0},
+    {"PHA", MN_TRACEFMT_IMP, 1},
+    {"EOR", MN_TRACEFMT_IMM, 1},
+    {"LSR", MN_TRACEFMT_ACC, 1},
+    {"ALR", MN_TRACEFMT_IMM, 0},
+    {"JMP", MN_TRACEFMT_ABS, 1},
+    {"EOR", MN_TRACEFMT_ABS, 1},
+    {"LSR", MN_TRACEFMT_ABS, 1},
+    {"SRE", MN_TRACEFMT_ABS, 0},
+    {"BVC", MN_TRACEFMT_REL, 1},
+    {"EOR", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"SRE", MN_TRACEFMT_IZY, 0},
+    {"NOP", MN_TRACEFMT_ZPX, 0},
+    {"EOR", MN_TRACEFMT_ZPX, 1},
+    {"LSR", MN_TRACEFMT_ZPX, 1},
+    {"SRE", MN_TRACEFMT_ZPX, 0},
+    {"CLI", MN_TRACEFMT_IMP, 1},
+    {"EOR", MN_TRACEFMT_ABY, 1},
+    {"NOP", MN_TRACEFMT_IMP, 0},
+    {"SRE", MN_TRACEFMT_ABY, 0},
+    {"NOP", MN_TRACEFMT_ABX, 0},
+    {"EOR", MN_TRACEFMT_ABX, 1},
+    {"LSR", MN_TRACEFMT_ABX, 1},
+    {"SRE", MN_TRACEFMT_ABX, 0},
+    {"RTS", MN_TRACEFMT_IMP, 1},
+    {"ADC", MN_TRACEFMT_IZX, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"RRA", MN_TRACEFMT_IZX, 0},
+    {"NOP", MN_TRACEFMT_ZP, 0},
+    {"ADC", MN_TRACEFMT_ZP, 1},
+    {"ROR", MN_TRACEFMT_ZP, 1},
+    {"RRA", MN_TRACEFMT_ZP, 0},
+    {"PLA", MN_TRACEFMT_IMP, 1},
+    {"ADC", MN_TRACEFMT_IMM, 1},
+    {"ROR", MN_TRACEFMT_ACC, 1},
+    {"ARR", MN_TRACEFMT_IMM, 0},
+    {"JMP", MN_TRACEFMT_IND, 1},
+    {"ADC", MN_TRACEFMT_ABS, 1},
+    {"ROR", MN_TRACEFMT_ABS, 1},
+    {"RRA", MN_TRACEFMT_ABS, 0},
+    {"BVS", MN_TRACEFMT_REL, 1},
+    {"ADC", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"RRA", MN_TRACEFMT_IZY, 0},
+    {"NOP", MN_TRACEFMT_ZPX, 0},
+    {"ADC", MN_TRACEFMT_ZPX, 1},
+    {"ROR", MN_TRACEFMT_ZPX, 1},
+    {"RRA", MN_TRACEFMT_ZPX, 0},
+    {"SEI", MN_TRACEFMT_IMP, 1},
+    {"ADC", MN_TRACEFMT_ABY, 1},
+    {"NOP", MN_TRACEFMT_IMP, 0},
+    {"RRA", MN_TRACEFMT_ABY, 0},
+    {"NOP", MN_TRACEFMT_ABX, 0},
+    {"ADC", MN_TRACEFMT_ABX, 1},
+    {"ROR", MN_TRACEFMT_ABX, 1},
+    {"RRA", MN_TRACEFMT_ABX, 0},
+    {"NOP", MN_TRACEFMT_IMM, 0},
+    {"STA", MN_TRACEFMT_IZX, 1},
+    {"NOP", MN_TRACEFMT_IMM, 0},
+    {"SAX", MN_TRACEFMT_IZX, 0},
+    {"STY", MN_TRACEFMT_ZP, 1},
+    {"STA", MN_TRACEFMT_ZP, 1},
+    {"STX", MN_TRACEFMT_ZP, 1},
+    {"SAX", MN_TRACEFMT_ZP, 0},
+    {"DEY", MN_TRACEFMT_IMP, 1},
+    {"NOP", MN_TRACEFMT_IMM, 0},
+    {"TXA", MN_TRACEFMT_IMP, 1},
+    {"XAA", MN_TRACEFMT_IMM, 0},
+    {"STY", MN_TRACEFMT_ABS, 1},
+    {"STA", MN_TRACEFMT_ABS, 1},
+    {"STX", MN_TRACEFMT_ABS, 1},
+    {"SAX", MN_TRACEFMT_ABS, 0},
+    {"BCC", MN_TRACEFMT_REL, 1},
+    {"STA", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"AHX", MN_TRACEFMT_IZY, 0},
+    {"STY", MN_TRACEFMT_ZPX, 1},
+    {"STA", MN_TRACEFMT_ZPX, 1},
+    {"STX", MN_TRACEFMT_ZPY, 1},
+    {"SAX", MN_TRACEFMT_ZPY, 0},
+    {"TYA", MN_TRACEFMT_IMP, 1},
+    {"STA", MN_TRACEFMT_ABY, 1},
+    {"TXS", MN_TRACEFMT_IMP, 1},
+    {"TAS", MN_TRACEFMT_ABY, 0},
+    {"SHY", MN_TRACEFMT_ABX, 0},
+    {"STA", MN_TRACEFMT_ABX, 1},
+    {"SHX", MN_TRACEFMT_ABY, 0},
+    {"AHX", MN_TRACEFMT_ABY, 0},
+    {"LDY", MN_TRACEFMT_IMM, 1},
+    {"LDA", MN_TRACEFMT_IZX, 1},
+    {"LDX", MN_TRACEFMT_IMM, 1},
+    {"LAX", MN_TRACEFMT_IZX, 0},
+    {"LDY", MN_TRACEFMT_ZP, 1},
+    {"LDA", MN_TRACEFMT_ZP, 1},
+    {"LDX", MN_TRACEFMT_ZP, 1},
+    {"LAX", MN_TRACEFMT_ZP, 0},
+    {"TAY", MN_TRACEFMT_IMP, 1},
+    {"LDA", MN_TRACEFMT_IMM, 1},
+    {"TAX", MN_TRACEFMT_IMP, 1},
+    {"LAX", MN_TRACEFMT_IMM, 0},
+    {"LDY", MN_TRACEFMT_ABS, 1},
+    {"LDA", MN_TRACEFMT_ABS, 1},
+    {"LDX", MN_TRACEFMT_ABS, 1},
+    {"LAX", MN_TRACEFMT_ABS, 0},
+    {"BCS", MN_TRACEFMT_REL, 1},
+    {"LDA", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"LAX", MN_TRACEFMT_IZY, 0},
+    {"LDY", MN_TRACEFMT_ZPX, 1},
+    {"LDA", MN_TRACEFMT_ZPX, 1},
+    {"LDX", MN_TRACEFMT_ZPY, 1},
+    {"LAX", MN_TRACEFMT_ZPY, 0},
+    {"CLV", MN_TRACEFMT_IMP, 1},
+    {"LDA", MN_TRACEFMT_ABY, 1},
+    {"TSX", MN_TRACEFMT_IMP, 1},
+    {"LAS", MN_TRACEFMT_ABY, 0},
+    {"LDY", MN_TRACEFMT_ABX, 1},
+    {"LDA", MN_TRACEFMT_ABX, 1},
+    {"LDX", MN_TRACEFMT_ABY, 1},
+    {"LAX", MN_TRACEFMT_ABY, 0},
+    {"CPY", MN_TRACEFMT_IMM, 1},
+    {"CMP", MN_TRACEFMT_IZX, 1},
+    {"NOP", MN_TRACEFMT_IMM, 0},
+    {"DCP", MN_TRACEFMT_IZX, 0},
+    {"CPY", MN_TRACEFMT_ZP, 1},
+    {"CMP", MN_TRACEFMT_ZP, 1},
+    {"DEC", MN_TRACEFMT_ZP, 1},
+    {"DCP", MN_TRACEFMT_ZP, 0},
+    {"INY", MN_TRACEFMT_IMP, 1},
+    {"CMP", MN_TRACEFMT_IMM, 1},
+    {"DEX", MN_TRACEFMT_IMP, 1},
+    {"AXS", MN_TRACEFMT_IMM, 0},
+    {"CPY", MN_TRACEFMT_ABS, 1},
+    {"CMP", MN_TRACEFMT_ABS, 1},
+    {"DEC", MN_TRACEFMT_ABS, 1},
+    {"DCP", MN_TRACEFMT_ABS, 0},
+    {"BNE", MN_TRACEFMT_REL, 1},
+    {"CMP", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"DCP", MN_TRACEFMT_IZY, 0},
+    {"NOP", MN_TRACEFMT_ZPX, 0},
+    {"CMP", MN_TRACEFMT_ZPX, 1},
+    {"DEC", MN_TRACEFMT_ZPX, 1},
+    {"DCP", MN_TRACEFMT_ZPX, 0},
+    {"CLD", MN_TRACEFMT_IMP, 1},
+    {"CMP", MN_TRACEFMT_ABY, 1},
+    {"NOP", MN_TRACEFMT_IMP, 0},
+    {"DCP", MN_TRACEFMT_ABY, 0},
+    {"NOP", MN_TRACEFMT_ABX, 0},
+    {"CMP", MN_TRACEFMT_ABX, 1},
+    {"DEC", MN_TRACEFMT_ABX, 1},
+    {"DCP", MN_TRACEFMT_ABX, 0},
+    {"CPX", MN_TRACEFMT_IMM, 1},
+    {"SBC", MN_TRACEFMT_IZX, 1},
+    {"NOP", MN_TRACEFMT_IMM, 0},
+    {"ISC", MN_TRACEFMT_IZX, 0},
+    {"CPX", MN_TRACEFMT_ZP, 1},
+    {"SBC", MN_TRACEFMT_ZP, 1},
+    {"INC", MN_TRACEFMT_ZP, 1},
+    {"ISC", MN_TRACEFMT_ZP, 0},
+    {"INX", MN_TRACEFMT_IMP, 1},
+    {"SBC", MN_TRACEFMT_IMM, 1},
+    {"NOP", MN_TRACEFMT_IMP, 1},
+    {"SBC", MN_TRACEFMT_IMM, 0},
+    {"CPX", MN_TRACEFMT_ABS, 1},
+    {"SBC", MN_TRACEFMT_ABS, 1},
+    {"INC", MN_TRACEFMT_ABS, 1},
+    {"ISC", MN_TRACEFMT_ABS, 0},
+    {"BEQ", MN_TRACEFMT_REL, 1},
+    {"SBC", MN_TRACEFMT_IZY, 1},
+    {"STP", MN_TRACEFMT_IMP, 0},
+    {"ISC", MN_TRACEFMT_IZY, 0},
+    {"NOP", MN_TRACEFMT_ZPX, 0},
+    {"SBC", MN_TRACEFMT_ZPX, 1},
+    {"INC", MN_TRACEFMT_ZPX, 1},
+    {"ISC", MN_TRACEFMT_ZPX, 0},
+    {"SED", MN_TRACEFMT_IMP, 1},
+    {"SBC", MN_TRACEFMT_ABY, 1},
+    {"NOP", MN_TRACEFMT_IMP, 0},
+    {"ISC", MN_TRACEFMT_ABY, 0},
+    {"NOP", MN_TRACEFMT_ABX, 0},
+    {"SBC", MN_TRACEFMT_ABX, 1},
+    {"INC", MN_TRACEFMT_ABX, 1},
+    {"ISC", MN_TRACEFMT_ABX, 0}
+
+};
+
+static void mn_tracefmt_print(MNTraceRecord *record) {
+    char bytes[9];
+    char operand[32];
+    unsigned char mode = opcodes[record->opcode].mode;
+    unsigned short int addr = record->operands[0]|(record->operands[1]<<8);
+
+    switch(sizes[mode]){
+        case 1:
+            sprintf(bytes, "%02X", record->opcode);
+            break;
+        case 2:
+            sprintf(bytes, "%02X %02X", record->opcode,
+                    record->operands[0]);
+            break;
+        default:
+            sprintf(bytes, "%02X %02X %02X", record->opcode,
+                    record->operands[0], record->operands[1]);
+    }
+
+    switch(mode){
+        case MN_TRACEFMT_IMP:
+            operand[0] = '\0';
+            break;
+        case MN_TRACEFMT_ACC:
+            sprintf(operand, " A");
+            break;
+        case MN_TRACEFMT_IMM:
+            sprintf(operand, " #$%02X", record->operands[0]);
+            break;
+        case MN_TRACEFMT_ZP:
+            sprintf(operand, " $%02X", record->operands[0]);
+            break;
+        case MN_TRACEFMT_ZPX:
+            sprintf(operand, " $%02X,X", record->operands[0]);
+            break;
+        case MN_TRACEFMT_ZPY:
+            sprintf(operand, " $%02X,Y", record->operands[0]);
+            break;
+        case MN_TRACEFMT_ABS:
+            sprintf(operand, " $%04X", addr);
+            break;
+        case MN_TRACEFMT_ABX:
+            sprintf(operand, " $%04X,X", addr);
+            break;
+        case MN_TRACEFMT_ABY:
+            sprintf(operand, " $%04X,Y", addr);
+            break;
+        case MN_TRACEFMT_IND:
+            sprintf(operand, " ($%04X)", addr);
+            break;
+        case MN_TRACEFMT_IZX:
+            sprintf(operand, " ($%02X,X)", record->operands[0]);
+            break;
+        case MN_TRACEFMT_IZY:
+            sprintf(operand, " ($%02X),Y", record->operands[0]);
+            break;
+        case MN_TRACEFMT_REL:
+            /* The target is relative to the address of the next
+             * instruction */
+            sprintf(operand, " $%04X", (record->pc+2+
+                                       (signed char)record->operands[0])&
+                                      0xFFFF);
+            break;
+    }
+
+    printf("%04X  %-8s %c%s%-*sA:%02X X:%02X Y:%02X P:%02X SP:%02X "
+           "PPU:%3u,%3u CYC:%lu\n", record->pc, bytes,
+           opcodes[record->opcode].official ? ' ' : '*',
+           opcodes[record->opcode].name, 32-3, operand, record->a,
+           record->x, record->y, record->p|(1<<5), record->s,
+           record->scanline, record->dot, record->cycles);
+}
+
+int main(int argc, char **argv) {
+    FILE *fp;
+    unsigned char buffer[MN_TRACE_RECORD_SIZE];
+    MNTraceRecord record;
+
+    if(argc < 2){
+        fprintf(stderr, "USAGE: %s [TRACE]\nFormats a MibiNES CPU trace as "
+                "text\n", argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    fp = fopen(argv[1], "rb");
+    if(fp == NULL){
+        fprintf(stderr, "%s: Failed to open \"%s\"!\n", argv[0], argv[1]);
+
+        return EXIT_FAILURE;
+    }
+
+    if(mn_trace_read_header(fp)){
+        fprintf(stderr, "%s: \"%s\" is not a valid trace!\n", argv[0],
+                argv[1]);
+        fclose(fp);
+
+        return EXIT_FAILURE;
+    }
+
+    while(fread(buffer, 1, MN_TRACE_RECORD_SIZE, fp) == MN_TRACE_RECORD_SIZE){
+        mn_trace_read_record(&record, buffer);
+        mn_tracefmt_print(&record);
+    }
+
+    fclose(fp);
+
+    return EXIT_SUCCESS;
+}